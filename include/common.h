@@ -10,8 +10,10 @@
 #include <mutex>
 #include <atomic>
 #include <chrono>
+#include <locale>
 #include <cstdio>
 #include <memory>
+#include <thread>
 #include <codecvt>
 #include <cstdint>
 #include <fstream>
@@ -23,15 +25,28 @@
 
 #if defined(_WIN32) || defined(WIN32)
 #include <tchar.h>
+#include <intrin.h>
 #include <crtdefs.h>
 #include <Windows.h>
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+#pragma comment(lib, "Synchronization.lib") // WaitOnAddress
+#endif  /* _WIN32_WINNT >= 0x0602 */
 #else // Linux
 #include <unistd.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif // #ifdef __linux__
 #endif // #if defined(_WIN32) || defined(WIN32)
 
 #include "system_constituent_version.h"
 
+#if defined(_MSC_VER) && _MSC_VER < 1900
+// VS2013不支持thread_local，只能用于POD类型
+#define thread_local    __declspec(thread)
+#endif  /* _MSC_VER < 1900 */
+
 
 #if defined(_WIN32) || defined(WIN32)
 struct timezone
@@ -73,31 +88,29 @@ inline int gettimeofday(struct timeval* tv, struct timezone* tz)
 
 #endif // #if defined(_WIN32) || defined(WIN32)
 
-template<class T> inline auto auto_max(T&& t) -> decltype(::std::forward<T>(t))
+// 按值返回，避免返回临时对象的引用
+template<class T> inline typename ::std::decay<T>::type auto_max(T&& t)
 {
     return ::std::forward<T>(t);
 }
 
 template<class T1, class T2, class... Args> inline
-auto auto_max(T1&& t1, T2&& t2, Args&&... args)
-    -> decltype(::std::forward<T1>(t1) > ::std::forward<T2>(t2) ? ::std::forward<T1>(t1) : ::std::forward<T2>(t2))
+typename ::std::common_type<T1, T2, Args...>::type auto_max(T1&& t1, T2&& t2, Args&&... args)
 {
-    return auto_max(::std::forward<T1>(t1) > ::std::forward<T2>(t2) ?
-        ::std::forward<T1>(t1) : ::std::forward<T2>(t2), ::std::forward<Args>(args)...);
+    return auto_max(t1 > t2 ? ::std::forward<T1>(t1) : ::std::forward<T2>(t2), ::std::forward<Args>(args)...);
 }
 
 
-template<class T> inline auto auto_min(T&& t) -> decltype(::std::forward<T>(t))
+// 按值返回，避免返回临时对象的引用
+template<class T> inline typename ::std::decay<T>::type auto_min(T&& t)
 {
     return ::std::forward<T>(t);
 }
 
 template<class T1, class T2, class... Args> inline
-auto auto_min(T1&& t1, T2&& t2, Args&&... args)
--> decltype(::std::forward<T1>(t1) < ::std::forward<T2>(t2) ? ::std::forward<T1>(t1) : ::std::forward<T2>(t2))
+typename ::std::common_type<T1, T2, Args...>::type auto_min(T1&& t1, T2&& t2, Args&&... args)
 {
-    return auto_min(::std::forward<T1>(t1) < ::std::forward<T2>(t2) ?
-        ::std::forward<T1>(t1) : ::std::forward<T2>(t2), ::std::forward<Args>(args)...);
+    return auto_min(t1 < t2 ? ::std::forward<T1>(t1) : ::std::forward<T2>(t2), ::std::forward<Args>(args)...);
 }
 
 
@@ -125,6 +138,20 @@ struct function_wapper
 };
 
 
+// 自旋等待提示（x86 pause），降低自旋时的功耗和对同一核心其他超线程的影响
+inline void cpu_relax()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    ::std::atomic_signal_fence(::std::memory_order_seq_cst);
+#endif
+}
+
 // 自旋锁
 class spin_mutex
 {
@@ -145,6 +172,305 @@ public:
     void unlock(){ flag.clear(::std::memory_order_release); }
 };
 
+// 测试-测试-设置自旋锁：等待时只读锁状态，不反复独占缓存行; 竞争失败后指数退避，退避达到上限后让出CPU
+class ttas_mutex
+{
+private:
+    ::std::atomic<bool> m_locked{ false };
+    static const size_t max_backoff = 1024;
+public:
+    ttas_mutex() = default;
+    ttas_mutex(const ttas_mutex&) = delete;
+    ttas_mutex& operator= (const ttas_mutex&) = delete;
+    void lock()
+    {
+        size_t backoff = 1;
+        while (m_locked.exchange(true, ::std::memory_order_acquire))
+        {
+            while (m_locked.load(::std::memory_order_relaxed))
+            {
+                for (size_t i = 0; i < backoff; i++)
+                    cpu_relax();
+                if (backoff < max_backoff)
+                    backoff <<= 1;
+                else
+                    ::std::this_thread::yield();
+            }
+        }
+    }
+    bool try_lock(){ return !m_locked.load(::std::memory_order_relaxed) && !m_locked.exchange(true, ::std::memory_order_acquire); }
+    void unlock(){ m_locked.store(false, ::std::memory_order_release); }
+};
+
+// 排队自旋锁：按取号顺序获得锁（公平），只有下一个获得锁的线程自旋等待
+class ticket_mutex
+{
+private:
+    ::std::atomic<uint32_t> m_next{ 0 };
+    ::std::atomic<uint32_t> m_serving{ 0 };
+    static const size_t max_spins = 8;
+public:
+    ticket_mutex() = default;
+    ticket_mutex(const ticket_mutex&) = delete;
+    ticket_mutex& operator= (const ticket_mutex&) = delete;
+    void lock()
+    {
+        auto ticket = m_next.fetch_add(1, ::std::memory_order_relaxed);
+        for (size_t spins = 1;; spins++)
+        {
+            auto serving = m_serving.load(::std::memory_order_acquire);
+            if (serving == ticket)
+                return;
+            // 只有下一个号码的线程自旋，其余线程让出CPU; 自旋过久时持有锁的线程可能被换出，也让出CPU
+            if (ticket - serving > 1 || spins >= max_spins)
+                ::std::this_thread::yield();
+            else
+                for (size_t i = 0; i < 32; i++)
+                    cpu_relax();
+        }
+    }
+    bool try_lock()
+    {
+        auto serving = m_serving.load(::std::memory_order_relaxed);
+        auto ticket = serving;
+        return m_next.compare_exchange_strong(ticket, serving + 1, ::std::memory_order_acquire);
+    }
+    void unlock(){ m_serving.store(m_serving.load(::std::memory_order_relaxed) + 1, ::std::memory_order_release); }
+};
+
+/* MCS队列锁（K42变体）：等待的线程在各自栈上的队列节点自旋，释放时只通知下一个线程，没有缓存行争用
+*  持有锁时不需要队列节点，接口和std::mutex相同
+**/
+class mcs_mutex
+{
+private:
+    struct node
+    {
+        // 锁：队尾节点; 队列节点：不为空时等待
+        ::std::atomic<node*> tail;
+        // 锁：第一个等待的节点; 队列节点：后继节点
+        ::std::atomic<node*> next;
+    };
+    node m_node;
+    static const size_t max_spins = 64;
+    // 队列节点的等待标记，不会被解引用
+    static node* waiting(){ return reinterpret_cast<node*>(uintptr_t(1)); }
+public:
+    mcs_mutex()
+    {
+        m_node.tail.store(nullptr, ::std::memory_order_relaxed);
+        m_node.next.store(nullptr, ::std::memory_order_relaxed);
+    }
+    mcs_mutex(const mcs_mutex&) = delete;
+    mcs_mutex& operator= (const mcs_mutex&) = delete;
+    void lock()
+    {
+        while (true)
+        {
+            auto prev = m_node.tail.load(::std::memory_order_acquire);
+            if (!prev)
+            { // 没有线程持有锁，队尾指向锁本身
+                if (m_node.tail.compare_exchange_strong(prev, &m_node, ::std::memory_order_acquire))
+                    return;
+                continue;
+            }
+            node current;
+            current.tail.store(waiting(), ::std::memory_order_relaxed);
+            current.next.store(nullptr, ::std::memory_order_relaxed);
+            if (!m_node.tail.compare_exchange_strong(prev, &current, ::std::memory_order_acq_rel))
+                continue;
+            prev->next.store(&current, ::std::memory_order_release);
+            for (size_t spins = 1; current.tail.load(::std::memory_order_acquire) == waiting(); spins++)
+            {
+                cpu_relax();
+                if (spins >= max_spins) // 长时间等待时每次都让出CPU，前一个线程可能被换出
+                    ::std::this_thread::yield();
+            }
+            // 获得锁后将后继节点转移到锁中，当前节点在返回后失效
+            auto succ = current.next.load(::std::memory_order_acquire);
+            if (!succ)
+            {
+                m_node.next.store(nullptr, ::std::memory_order_relaxed);
+                auto expected = &current;
+                if (m_node.tail.compare_exchange_strong(expected, &m_node, ::std::memory_order_acq_rel))
+                    return;
+                // 有新的线程正在加入队列，等待其设置后继节点
+                while (!(succ = current.next.load(::std::memory_order_acquire)))
+                    cpu_relax();
+            }
+            m_node.next.store(succ, ::std::memory_order_relaxed);
+            return;
+        }
+    }
+    bool try_lock()
+    {
+        node* expected = nullptr;
+        return m_node.tail.compare_exchange_strong(expected, &m_node, ::std::memory_order_acquire);
+    }
+    void unlock()
+    {
+        auto succ = m_node.next.load(::std::memory_order_acquire);
+        if (!succ)
+        {
+            auto expected = &m_node;
+            if (m_node.tail.compare_exchange_strong(expected, nullptr, ::std::memory_order_release))
+                return;
+            // 有新的线程正在加入队列，等待其设置后继节点
+            while (!(succ = m_node.next.load(::std::memory_order_acquire)))
+                cpu_relax();
+        }
+        succ->tail.store(nullptr, ::std::memory_order_release);
+    }
+};
+
+/* 自适应互斥锁：先自旋一段时间，仍未获得锁时在内核中等待（Linux: futex; Windows 8+: WaitOnAddress）
+*  不支持内核地址等待的平台让出CPU后重试
+**/
+class adaptive_mutex
+{
+private:
+    // 0: 未锁定; 1: 锁定; 2: 锁定且可能有线程在内核中等待
+    ::std::atomic<int> m_state{ 0 };
+    static const size_t spin_count = 128;
+    void wait(int value)
+    {
+#if defined(_WIN32) || defined(WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+        WaitOnAddress(&m_state, &value, sizeof(value), INFINITE);
+#else  /* _WIN32_WINNT < 0x0602 */
+        (void)value;
+        SwitchToThread();
+#endif  /* _WIN32_WINNT >= 0x0602 */
+#elif defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<int*>(&m_state), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else  /* UNIX */
+        (void)value;
+        ::std::this_thread::yield();
+#endif  /* _WIN32 */
+    }
+    void wake_one()
+    {
+#if defined(_WIN32) || defined(WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+        WakeByAddressSingle(&m_state);
+#endif  /* _WIN32_WINNT >= 0x0602 */
+#elif defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<int*>(&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif  /* _WIN32 */
+    }
+public:
+    adaptive_mutex() = default;
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator= (const adaptive_mutex&) = delete;
+    void lock()
+    {
+        int expected = 0;
+        if (m_state.compare_exchange_strong(expected, 1, ::std::memory_order_acquire))
+            return;
+        for (size_t i = 0; i < spin_count; i++)
+        {
+            cpu_relax();
+            expected = 0;
+            if (m_state.load(::std::memory_order_relaxed) == 0 && m_state.compare_exchange_weak(expected, 1, ::std::memory_order_acquire))
+                return;
+        }
+        // 标记有线程等待后进入内核等待，被唤醒的线程同样标记，保证释放时唤醒其余等待的线程
+        while (m_state.exchange(2, ::std::memory_order_acquire) != 0)
+            wait(2);
+    }
+    bool try_lock()
+    {
+        int expected = 0;
+        return m_state.compare_exchange_strong(expected, 1, ::std::memory_order_acquire);
+    }
+    void unlock()
+    {
+        if (m_state.exchange(0, ::std::memory_order_release) == 2)
+            wake_one();
+    }
+};
+
+// 分片计数器：每个分片独占一个缓存行，线程只修改自己的分片，读取时对所有分片求和
+// 适用于频繁修改、较少读取的统计计数; 各分片独立修改，读取的结果不是同一时刻的快照
+class sharded_counter
+{
+public:
+    static const size_t cache_line_size = 64;
+    static const size_t shard_number = 32;
+
+private:
+    struct shard
+    {
+        ::std::atomic<size_t> value;
+        char padding[cache_line_size - sizeof(::std::atomic<size_t>)];
+    };
+    // 分片按缓存行对齐存储在对象内部，不和相邻的成员共享缓存行
+    char m_buffer[(shard_number + 1) * cache_line_size];
+    shard* m_shards;
+
+    // 当前线程使用的分片序号+1，0为未分配
+    static size_t& shard_slot()
+    {
+        static thread_local size_t slot = 0;
+        return slot;
+    }
+    // 当前线程使用的分片，未指定时由线程ID散列得到
+    static size_t this_shard()
+    {
+        auto& slot = shard_slot();
+        if (!slot)
+        {
+            uint64_t hash = (uint64_t)::std::hash<::std::thread::id>()(::std::this_thread::get_id());
+            slot = (size_t)((hash * 0x9E3779B97F4A7C15ull) >> 59) % shard_number + 1;
+        }
+        return slot - 1;
+    }
+
+public:
+    sharded_counter()
+    {
+        m_shards = reinterpret_cast<shard*>((reinterpret_cast<uintptr_t>(m_buffer) + cache_line_size - 1) & ~(uintptr_t)(cache_line_size - 1));
+        for (size_t i = 0; i < shard_number; i++)
+            ::new (&m_shards[i].value) ::std::atomic<size_t>(0);
+    }
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    // 指定当前线程使用的分片，线程池的工作线程按序号使用不同的分片; 只影响性能
+    static void set_this_shard(size_t index)
+    {
+        shard_slot() = index % shard_number + 1;
+    }
+    void add(size_t value)
+    {
+        m_shards[this_shard()].value.fetch_add(value, ::std::memory_order_acq_rel);
+    }
+    // 减少的值可能记录在其他分片，各分片按无符号数回绕，总和仍然正确
+    void sub(size_t value)
+    {
+        m_shards[this_shard()].value.fetch_sub(value, ::std::memory_order_acq_rel);
+    }
+    size_t load() const
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < shard_number; i++)
+            result += m_shards[i].value.load(::std::memory_order_acquire);
+        return result;
+    }
+    void operator++(int)
+    {
+        add(1);
+    }
+    void operator+=(size_t value)
+    {
+        add(value);
+    }
+    void operator-=(size_t value)
+    {
+        sub(value);
+    }
+};
+
 
 SYSCONAPI_EXTERN ::std::mutex g_log_lock;
 SYSCONAPI_EXTERN ::std::ofstream g_log_ofstream;
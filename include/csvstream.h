@@ -14,12 +14,12 @@
 #include <fstream>
 #include <sstream>
 
-// CSV逗号分隔文件
-class csvstream
+// CSV逗号分隔文件，lock_type为读写锁类型[spin_mutex|ttas_mutex|ticket_mutex|mcs_mutex|adaptive_mutex]
+template<class lock_type = spin_mutex> class basic_csvstream
 {
 private:
     // 锁定文件读写
-    mutable spin_mutex m_lock;
+    mutable lock_type m_lock;
     // CSV行列数据
     ::std::deque<::std::vector<::std::string>> m_data;
 
@@ -100,11 +100,11 @@ private:
     void _get_cell(size_t row, size_t col, skip_cell_t&&) const{}
     template<class T> void _get_cell(size_t row, size_t col, T&&) const
     {
-        static_assert(false, "T must not be a r-value reference.");
+        static_assert(sizeof(T) == 0, "T must not be a r-value reference.");
     }
     template<class T> void _get_cell(size_t row, size_t col, const T&) const
     {
-        static_assert(false, "T must not be a const reference.");
+        static_assert(sizeof(T) == 0, "T must not be a const reference.");
     }
 
     // 读取、写入单元格
@@ -116,7 +116,7 @@ private:
     template<class T> void _sync_cell(sync_get_t&&, size_t row, size_t col, T&& val){ _get_cell(row, col, ::std::forward<T>(val)); }
     template<class Sync, class T> void _sync_cell(Sync&&, size_t row, size_t col, T&& val)
     {
-        static_assert(false, "Sync must be csvstream::sync_set or csvstream::sync_get.");
+        static_assert(sizeof(Sync) == 0, "Sync must be csvstream::sync_set or csvstream::sync_get.");
     }
 
 
@@ -144,7 +144,7 @@ private:
     template<class... Args> void _sync_row(sync_get_t&&, size_t row, size_t col, Args&&... args){ _get_row(row, col, ::std::forward<Args>(args)...); }
     template<class Sync, class... Args> void _sync_row(Sync&&, size_t row, size_t col, Args&&... args)
     {
-        static_assert(false, "Sync must be csvstream::sync_set or csvstream::sync_get.");
+        static_assert(sizeof(Sync) == 0, "Sync must be csvstream::sync_set or csvstream::sync_get.");
     }
 
 
@@ -172,7 +172,7 @@ private:
     template<class... Args> void _sync_col(sync_get_t&&, size_t row, size_t col, Args&&... args){ _get_col(row, col, ::std::forward<Args>(args)...); }
     template<class Sync, class... Args> void _sync_col(Sync&&, size_t row, size_t col, Args&&... args)
     {
-        static_assert(false, "Sync must be csvstream::sync_set or csvstream::sync_get.");
+        static_assert(sizeof(Sync) == 0, "Sync must be csvstream::sync_set or csvstream::sync_get.");
     }
 
 
@@ -187,15 +187,15 @@ private:
 #endif  /* _WIN32 */
 
 public:
-    csvstream() = default;
-    csvstream(const csvstream&) = delete;
-    csvstream& operator=(const csvstream&) = delete;
-    csvstream(csvstream&& right)
+    basic_csvstream() = default;
+    basic_csvstream(const basic_csvstream&) = delete;
+    basic_csvstream& operator=(const basic_csvstream&) = delete;
+    basic_csvstream(basic_csvstream&& right)
     {
         ::std::lock_guard<decltype(m_lock)> lck(right.m_lock);
         m_data = ::std::move(right.m_data);
     }
-    csvstream& operator=(csvstream&& right)
+    basic_csvstream& operator=(basic_csvstream&& right)
     {
         if (this == &right)
             return *this;
@@ -402,7 +402,7 @@ public:
     }
 
     // 交换两个工作表
-    void swap(csvstream& right)
+    void swap(basic_csvstream& right)
     {
         if (this == &right)
             return;
@@ -419,3 +419,6 @@ public:
     SYSCONAPI static const sync_set_t sync_set;
     SYSCONAPI static const sync_get_t sync_get;
 };
+
+// 默认使用spin_mutex的CSV文件
+typedef basic_csvstream<> csvstream;
@@ -0,0 +1,184 @@
+﻿/**********************************************************
+* 事件对象（Win32 Event的POSIX兼容实现）
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
+***********************************************************/
+
+#pragma once
+
+#if defined(_WIN32) || defined(WIN32)
+#include <Windows.h>
+#else // UNIX
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+
+typedef void*           HANDLE;
+typedef int             BOOL;
+typedef unsigned long   DWORD;
+
+#ifndef TRUE
+#define TRUE    1
+#endif  /* TRUE */
+#ifndef FALSE
+#define FALSE   0
+#endif  /* FALSE */
+
+#define INFINITE                ((DWORD)0xFFFFFFFF)
+#define WAIT_OBJECT_0           ((DWORD)0x00000000)
+#define WAIT_TIMEOUT            ((DWORD)0x00000102)
+#define WAIT_FAILED             ((DWORD)0xFFFFFFFF)
+#define INVALID_HANDLE_VALUE    ((HANDLE)(intptr_t)-1)
+#define MAXIMUM_WAIT_OBJECTS    64
+
+
+// 等待块，每个线程同一时刻只会等待一次，线程结束前复用
+struct event_wait_block
+{
+    ::std::mutex lock;
+    ::std::condition_variable cv;
+    // 是否仍在等待
+    bool waiting = false;
+    // 激活等待的事件序号
+    DWORD signaled = 0;
+};
+
+// 事件对象，和Win32 Event语义相同
+struct event_object
+{
+    ::std::mutex lock;
+    // 手动复位事件
+    bool manual_reset;
+    // 当前是否有信号
+    bool state;
+    // 正在等待此事件的等待块和事件在等待列表中的序号
+    ::std::deque<::std::pair<event_wait_block*, DWORD>> waiters;
+
+    event_object(bool manual_reset_arg, bool initial_state)
+        : manual_reset(manual_reset_arg), state(initial_state)
+    {
+    }
+};
+
+inline bool is_valid_event(HANDLE handle)
+{
+    return !!handle && handle != INVALID_HANDLE_VALUE;
+}
+
+// 事件对象锁定时调用：激活等待块，返回是否激活成功
+inline bool event_fire_waiter(event_wait_block* wait_block, DWORD index)
+{
+    ::std::lock_guard<::std::mutex> lck(wait_block->lock);
+    if (!wait_block->waiting)
+        return false;
+    wait_block->waiting = false;
+    wait_block->signaled = index;
+    wait_block->cv.notify_one();
+    return true;
+}
+
+inline HANDLE CreateEventW(void* /*event_attributes*/, BOOL manual_reset, BOOL initial_state, const wchar_t* /*name*/)
+{
+    return new event_object(!!manual_reset, !!initial_state);
+}
+
+inline BOOL CloseHandle(HANDLE handle)
+{
+    if (!is_valid_event(handle))
+        return FALSE;
+    delete (event_object*)handle;
+    return TRUE;
+}
+
+inline BOOL SetEvent(HANDLE handle)
+{
+    if (!is_valid_event(handle))
+        return FALSE;
+    auto event = (event_object*)handle;
+    ::std::lock_guard<::std::mutex> lck(event->lock);
+    event->state = true;
+    while (!event->waiters.empty())
+    {
+        auto waiter = event->waiters.front();
+        event->waiters.pop_front();
+        if (event_fire_waiter(waiter.first, waiter.second) && !event->manual_reset)
+        { // 自动复位事件只激活一个等待的线程
+            event->state = false;
+            break;
+        }
+    }
+    return TRUE;
+}
+
+inline BOOL ResetEvent(HANDLE handle)
+{
+    if (!is_valid_event(handle))
+        return FALSE;
+    auto event = (event_object*)handle;
+    ::std::lock_guard<::std::mutex> lck(event->lock);
+    event->state = false;
+    return TRUE;
+}
+
+// 等待任意一个事件有信号，只支持wait_all=FALSE
+inline DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all, DWORD milliseconds)
+{
+    if (!count || count > MAXIMUM_WAIT_OBJECTS || wait_all)
+        return WAIT_FAILED;
+    for (DWORD i = 0; i < count; i++)
+        if (!is_valid_event(handles[i]))
+            return WAIT_FAILED;
+    static thread_local event_wait_block wait_block;
+    wait_block.lock.lock();
+    wait_block.waiting = true;
+    wait_block.lock.unlock();
+    // 按序号登记等待，已有信号的事件直接激活（序号小的事件优先）
+    DWORD registered = 0;
+    for (; registered < count; registered++)
+    {
+        auto event = (event_object*)handles[registered];
+        ::std::lock_guard<::std::mutex> lck(event->lock);
+        if (event->state)
+        {
+            if (event_fire_waiter(&wait_block, registered) && !event->manual_reset)
+                event->state = false;
+            break;
+        }
+        event->waiters.push_back(::std::make_pair(&wait_block, registered));
+    }
+    DWORD result;
+    {
+        ::std::unique_lock<::std::mutex> lck(wait_block.lock);
+        if (milliseconds == INFINITE)
+            wait_block.cv.wait(lck, []{ return !wait_block.waiting; });
+        else
+            wait_block.cv.wait_for(lck, ::std::chrono::milliseconds(milliseconds), []{ return !wait_block.waiting; });
+        if (wait_block.waiting)
+        {
+            wait_block.waiting = false;
+            result = WAIT_TIMEOUT;
+        }
+        else
+            result = WAIT_OBJECT_0 + wait_block.signaled;
+    }
+    // 撤销其余事件中的等待登记，SetEvent只会在事件锁内访问等待块
+    for (DWORD i = 0; i < registered; i++)
+    {
+        auto event = (event_object*)handles[i];
+        ::std::lock_guard<::std::mutex> lck(event->lock);
+        event->waiters.erase(::std::remove_if(event->waiters.begin(), event->waiters.end(),
+            [](const ::std::pair<event_wait_block*, DWORD>& waiter){ return waiter.first == &wait_block; }), event->waiters.end());
+    }
+    return result;
+}
+
+inline DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+    return WaitForMultipleObjects(1, &handle, FALSE, milliseconds);
+}
+
+#endif // #if defined(_WIN32) || defined(WIN32)
@@ -1,13 +1,13 @@
 ﻿/**********************************************************
 * 安全的句柄、对象操作封装
-* 支持平台：Windows
-* 编译环境：VS2010+
+* 支持平台：Windows; Linux
+* 编译环境：VS2010+; g++ -std=c++11
 ***********************************************************/
 
 #pragma once
 
 #include <utility>
-#include <Windows.h>
+#include "event_object.h"
 
 
 class SAFE_HANDLE_OBJECT
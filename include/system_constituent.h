@@ -16,3 +16,5 @@
 #include "serial_port.h"
 // 线程池
 #include "threadpool.h"
+// 任务图
+#include "task_graph.h"
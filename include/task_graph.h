@@ -0,0 +1,280 @@
+﻿/**********************************************************
+* 任务图（有向无环图）
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
+***********************************************************/
+
+#pragma once
+
+#include "threadpool.h"
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// 任务图：节点和依赖关系建立一次，可以在线程池中重复运行; 就绪的节点由原子入度计数释放，稳定状态下运行任务图本身不分配内存
+class task_graph
+{
+public:
+    typedef size_t node_id;
+
+private:
+    struct node
+    {
+        task_object task;
+        // 依赖此节点的节点
+        ::std::vector<node*> successors;
+        // 入度
+        size_t in_degree = 0;
+        // 本次运行尚未完成的前驱节点数
+        ::std::atomic<size_t> pending{ 0 };
+        node(task_object&& task_arg) : task(::std::move(task_arg)){}
+    };
+    /* 添加到线程池的节点任务，未运行就被销毁（clear、stop、drop_oldest）时以broken_promise使任务图失败，并释放节点和后继节点
+    *  移动构造不抛出异常，直接保存在任务对象内部，不从task_arena分配
+    **/
+    class node_task
+    {
+    private:
+        task_graph* m_graph;
+        node* m_ready;
+
+    public:
+        node_task(task_graph* graph, node* ready) : m_graph(graph), m_ready(ready){}
+        node_task(node_task&& other) noexcept : m_graph(other.m_graph), m_ready(other.m_ready)
+        {
+            other.m_ready = nullptr;
+        }
+        node_task(const node_task&) = delete;
+        node_task& operator=(const node_task&) = delete;
+        ~node_task()
+        {
+            if (m_ready)
+                m_graph->abandon(m_ready);
+        }
+        void operator()()
+        {
+            auto ready = m_ready;
+            m_ready = nullptr;
+            m_graph->execute(ready);
+        }
+        bool released() const
+        {
+            return !m_ready;
+        }
+    };
+    // 等待任务图完成的对象，用于线程池的线程等待时帮助运行
+    struct completion
+    {
+        task_graph* graph;
+        void wait() const
+        {
+            ::std::unique_lock<::std::mutex> lck(graph->m_wait_lock);
+            graph->m_wait_cv.wait(lck, [this]{ return graph->m_completed; });
+        }
+        template<class rep, class per>
+        ::std::future_status wait_for(const ::std::chrono::duration<rep, per>& rel_time) const
+        {
+            ::std::unique_lock<::std::mutex> lck(graph->m_wait_lock);
+            return graph->m_wait_cv.wait_for(lck, rel_time, [this]{ return graph->m_completed; }) ? ::std::future_status::ready : ::std::future_status::timeout;
+        }
+    };
+
+    // 节点存储，添加节点不移动已有节点
+    ::std::deque<node> m_nodes;
+    // 入度为0的节点，修改后在下一次运行前重新计算
+    ::std::vector<node*> m_roots;
+    bool m_modified = true;
+    bool m_acyclic = false;
+    // 运行状态，每次运行前重置
+    ::std::atomic<bool> m_running{ false };
+    ::std::atomic<size_t> m_remaining{ 0 };
+    ::std::atomic<bool> m_failed{ false };
+    ::std::exception_ptr m_exception;
+    spin_mutex m_exception_lock;
+    ::std::mutex m_wait_lock;
+    ::std::condition_variable m_wait_cv;
+    bool m_completed = false;
+    // 运行的线程池和添加节点任务的函数
+    void* m_pool = nullptr;
+    void(*m_post)(void* pool, task_graph* graph, node* ready) = nullptr;
+
+    /* 添加节点任务到线程池，线程池退出流程中在当前线程直接运行
+    *  超出容量被拒绝的节点任务已被销毁，和被清理的任务相同地使任务图失败
+    **/
+    template<bool handle_exception, class lock_type> static void post_node(void* pool, task_graph* graph, node* ready)
+    {
+        node_task task(graph, ready);
+        if (!((threadpool<handle_exception, lock_type>*)pool)->push(::std::move(task)) && !task.released())
+            task();
+    }
+    // 记录第一个异常，之后的节点不再运行
+    void fail(::std::exception_ptr exception)
+    {
+        ::std::lock_guard<spin_mutex> lck(m_exception_lock);
+        if (!m_exception)
+            m_exception = ::std::move(exception);
+        m_failed = true;
+    }
+    // 节点任务未运行就被销毁：任务图失败，不运行的节点照常释放后继节点，保证等待的线程返回
+    void abandon(node* current)
+    {
+        fail(broken_promise_exception());
+        execute(current);
+    }
+    // 检查是否有环并计算入度为0的节点，只在修改后重新计算
+    bool prepare()
+    {
+        if (!m_modified)
+            return m_acyclic;
+        m_roots.clear();
+        for (auto& val : m_nodes)
+        {
+            val.pending.store(val.in_degree, ::std::memory_order_relaxed);
+            if (!val.in_degree)
+                m_roots.push_back(&val);
+        }
+        auto ready = m_roots;
+        size_t visited = 0;
+        while (!ready.empty())
+        {
+            auto current = ready.back();
+            ready.pop_back();
+            visited++;
+            for (auto successor : current->successors)
+                if (!--successor->pending)
+                    ready.push_back(successor);
+        }
+        m_modified = false;
+        m_acyclic = visited == m_nodes.size();
+        return m_acyclic;
+    }
+    // 运行节点，释放后继节点：一个就绪的后继节点在当前线程继续运行，其余添加到线程池
+    void execute(node* current)
+    {
+        while (current)
+        {
+            if (!m_failed.load(::std::memory_order_relaxed))
+            {
+                try
+                {
+                    current->task();
+                }
+                catch (...)
+                {
+                    fail(::std::current_exception());
+                }
+            }
+            node* next = nullptr;
+            for (auto successor : current->successors)
+            {
+                if (successor->pending.fetch_sub(1, ::std::memory_order_acq_rel) == 1)
+                {
+                    if (next)
+                        m_post(m_pool, this, next);
+                    next = successor;
+                }
+            }
+            // 最后一个节点完成后不再访问任务图，运行的线程可能已经返回
+            if (m_remaining.fetch_sub(1, ::std::memory_order_acq_rel) == 1)
+            {
+                ::std::lock_guard<::std::mutex> lck(m_wait_lock);
+                m_completed = true;
+                m_wait_cv.notify_all();
+                return;
+            }
+            current = next;
+        }
+    }
+
+public:
+    task_graph() = default;
+    task_graph(const task_graph&) = delete;
+    task_graph& operator=(const task_graph&) = delete;
+
+    // 添加节点，返回节点序号; 运行中不能修改任务图
+    template<class Fn, class... Args> node_id add_node(Fn&& fn, Args&&... args)
+    {
+        assert(!m_running.load()); // Task graph must not be running
+        m_nodes.emplace_back(task_object(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)));
+        m_modified = true;
+        return m_nodes.size() - 1;
+    }
+    // 添加依赖：to在from完成后运行，序号无效时返回false
+    bool add_edge(node_id from, node_id to)
+    {
+        assert(!m_running.load()); // Task graph must not be running
+        if (from >= m_nodes.size() || to >= m_nodes.size() || from == to)
+            return false;
+        m_nodes[from].successors.push_back(&m_nodes[to]);
+        m_nodes[to].in_degree++;
+        m_modified = true;
+        return true;
+    }
+    // 删除所有节点
+    void clear()
+    {
+        assert(!m_running.load()); // Task graph must not be running
+        m_nodes.clear();
+        m_roots.clear();
+        m_modified = true;
+    }
+    // 获取节点数
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+    bool empty() const
+    {
+        return m_nodes.empty();
+    }
+    bool is_running() const
+    {
+        return m_running.load();
+    }
+
+    /* 在线程池中运行任务图，调用线程参与运行，返回时所有节点已完成
+    *  任务图有环或正在运行时返回false; 节点抛出异常时跳过尚未运行的节点，完成后重新抛出第一个异常
+    *  节点任务未运行就被线程池丢弃时抛出std::future_errc::broken_promise异常; 线程池的线程等待时帮助运行任务
+    **/
+    template<bool handle_exception, class lock_type> bool run(threadpool<handle_exception, lock_type>& pool)
+    {
+        bool expected = false;
+        if (!m_running.compare_exchange_strong(expected, true))
+            return false;
+        if (!prepare())
+        {
+            m_running = false;
+            return false;
+        }
+        if (m_nodes.empty())
+        {
+            m_running = false;
+            return true;
+        }
+        for (auto& val : m_nodes)
+            val.pending.store(val.in_degree, ::std::memory_order_relaxed);
+        m_pool = &pool;
+        m_post = &post_node<handle_exception, lock_type>;
+        m_remaining.store(m_nodes.size(), ::std::memory_order_relaxed);
+        m_failed = false;
+        m_exception = nullptr;
+        m_completed = false;
+        // 第一个入度为0的节点在调用线程运行
+        for (size_t i = 1; i < m_roots.size(); i++)
+            m_post(m_pool, this, m_roots[i]);
+        execute(m_roots.front());
+        pool.help_wait(completion{ this });
+        auto exception = m_exception;
+        m_exception = nullptr;
+        m_running = false;
+        if (exception)
+            ::std::rethrow_exception(exception);
+        return true;
+    }
+};
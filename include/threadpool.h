@@ -1,7 +1,7 @@
 ﻿/**********************************************************
 * 线程池控制类
-* 支持平台：Windows
-* 编译环境：VS2013+
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
 ***********************************************************/
 
 #pragma once
@@ -9,16 +9,35 @@
 #include "common.h"
 #include "safe_object.h"
 #include <list>
+#include <string>
 #include <deque>
+#include <vector>
+#include <climits>
 #include <mutex>
 #include <memory>
 #include <atomic>
 #include <future>
 #include <thread>
+#include <chrono>
 #include <cassert>
 #include <typeinfo>
+#include <exception>
 #include <functional>
-#include <Windows.h>
+#include <condition_variable>
+
+// C++20协程支持
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <optional>
+#define THREADPOOL_COROUTINE 1
+#endif // #if __has_include(<coroutine>)
+#endif // #if defined(__cpp_impl_coroutine) && defined(__has_include)
+
+/* 任务延迟统计：定义THREADPOOL_HISTOGRAM后记录每个任务的排队延迟和运行时间
+*  未定义时不记录时间戳，相关成员和接口不参与编译; 编译库和使用库的代码必须使用相同的定义
+**/
+//#define THREADPOOL_HISTOGRAM 1
 
 enum class thread_priority : uint16_t
 {
@@ -33,530 +52,4144 @@ enum class thread_priority : uint16_t
     idle,
 };
 
+// 线程亲和性
+enum class thread_affinity : uint16_t
+{
+    uninitialized,  // 不作改变
+    none,           // 恢复为进程可用的所有CPU
+    cpu_set,        // 所有线程在指定的CPU集合中运行
+    per_cpu,        // 线程依次固定到指定CPU集合中的一个CPU
+    spread_cores,   // 线程依次固定到不同物理核心的一个逻辑CPU（超线程只使用一个）
+    spread_numa,    // 线程依次分布到各NUMA节点，在节点的CPU上运行，内存优先从节点分配
+};
 
-// 线程池类; handle_exception: 是否处理捕获任务异常
-template<bool handle_exception = true> class threadpool
+// 任务调度模式
+enum class schedule_mode : uint16_t
 {
-private:
-    // 线程是否已启动
-    bool m_is_start = false;
-    // 线程数
-    ::std::atomic<int> m_thread_number{ 0 };
-    ::std::atomic<int> m_thread_started{ 0 };
-    // 线程队列
-    ::std::list<::std::tuple<::std::thread, SAFE_HANDLE_OBJECT, SAFE_HANDLE_OBJECT>> m_thread_object;
-    // 已销毁分离的线程对象
-    ::std::list<::std::tuple<::std::thread, SAFE_HANDLE_OBJECT, SAFE_HANDLE_OBJECT>> m_thread_destroy;
-    // 任务队列
-    ::std::deque<::std::function<void()>> m_tasks;
-    decltype(m_tasks) m_pause_tasks;
-    decltype(m_tasks)* m_push_tasks{ &m_tasks };
-    decltype(m_tasks) m_exception_tasks;
-    ::std::atomic<size_t> m_task_exception{ 0 };
-    ::std::atomic<size_t> m_task_completed{ 0 };
-    ::std::atomic<size_t> m_task_all{ 0 };
-    // 任务队列读写锁
-    mutable spin_mutex m_task_lock;
-    // 线程创建、销毁事件锁
-    ::std::recursive_mutex m_thread_lock;
-    // 通知事件
-    SAFE_HANDLE_OBJECT m_stop_thread; // 退出事件，关闭所有线程
-    SAFE_HANDLE_OBJECT m_notify_task; // 通知线程有新任务
-    // 线程优先级
-    thread_priority m_priority = thread_priority::uninitialized;
+    shared_queue,   // 所有任务进入同一个任务队列
+    work_stealing,  // 工作线程添加的任务进入本线程的任务队列，空闲线程从其他线程窃取任务
+};
 
-    enum class exit_event_t {
-        INITIALIZATION,
-        NORMAL,
-        PAUSE,
-        STOP_IMMEDIATELY,
-        WAIT_TASK_COMPLETE,
-    };
-    // 退出任务事件
-    ::std::atomic<exit_event_t> m_exit_event{ exit_event_t::INITIALIZATION };
+// 空闲线程的等待策略
+enum class idle_policy : uint16_t
+{
+    park,   // 直接进入内核等待
+    yield,  // 先让出CPU一段时间，再进入内核等待
+    spin,   // 先自旋（pause指令）一段时间，再让出CPU一段时间，最后进入内核等待
+};
 
-    // 线程入口函数
-    static size_t thread_entry(threadpool* object, HANDLE pause_event, HANDLE resume_event);
-    // 线程入口函数，线程启动时先执行一次启动函数
-    static size_t thread_entry_startup(threadpool* object, HANDLE pause_event, HANDLE resume_event, ::std::function<void()>& startup_fn);
-    // 线程运行前准备
-    size_t pre_run(HANDLE pause_event, HANDLE resume_event);
-    /* 线程任务调度函数
-    *  返回值 >= success_code 表示正常退出，< success_code 为非正常退出
-    *  run函数体本身堆栈中没有对象，移动ebp/rbp寄存器安全，可以不处理异常
-    **/
-    size_t run(HANDLE pause_event, HANDLE resume_event);
+// 任务优先级，每个优先级使用单独的任务队列
+enum class task_priority : uint16_t
+{
+    high,
+    normal, // push等接口添加的任务
+    low,
+};
 
-    // 新任务添加通知
-    void notify()
-    { // 通知一个线程
-        ::SetEvent(m_notify_task);
+// 任务队列超出容量时的处理策略
+enum class overflow_policy : uint16_t
+{
+    block,          // 阻塞添加任务的线程，直到有空位或者超时（超时后添加失败）
+    fail,           // 添加失败
+    caller_runs,    // 在添加任务的线程中直接运行
+    drop_oldest,    // 丢弃任务队列中最早的任务，调用丢弃回调
+};
+
+// 任务队列容量统计
+struct queue_statistics
+{
+    size_t capacity;        // 容量，0为不限制
+    size_t high_water;      // 任务队列（包括高、低优先级）的最大长度
+    size_t blocked;         // 等待过容量的任务数
+    size_t rejected;        // 超出容量而添加失败的任务数（包括等待超时）
+    size_t caller_runs;     // 超出容量而在添加任务的线程中运行的任务数
+    size_t dropped;         // 超出容量而被丢弃的任务数
+};
+
+// 自动调整线程数的原因
+enum class autoscale_reason : uint16_t
+{
+    below_minimum,      // 线程数小于最小值
+    above_maximum,      // 线程数大于最大值
+    queue_depth,        // 平均每个线程的排队任务数达到阈值
+    queue_delay,        // 估计的排队时间达到阈值
+    low_utilization,    // 任务队列为空且线程利用率低于阈值
+};
+
+// 自动调整线程数的记录
+struct autoscale_decision
+{
+    ::std::chrono::steady_clock::time_point time;
+    autoscale_reason reason;
+    int old_thread_number;
+    int new_thread_number;
+    // 调整时的任务队列数量
+    size_t queue_depth;
+    // 估计的排队时间（队列数量/完成速度），队列有任务但没有完成任务时为最大值
+    ::std::chrono::microseconds queue_delay;
+    // 调整间隔内的平均线程利用率
+    double utilization;
+};
+
+// 自动调整线程数的配置; 增加和减少使用不同的条件和连续间隔数，避免线程数来回振荡
+struct autoscale_config
+{
+    // 线程数范围，max_threads为0时使用逻辑CPU数
+    int min_threads = 1;
+    int max_threads = 0;
+    // 调整间隔，每个间隔采样8次线程利用率
+    ::std::chrono::milliseconds interval{ 100 };
+    // 平均每个线程的排队任务数或估计的排队时间达到阈值时增加线程
+    size_t grow_queue_depth = 4;
+    ::std::chrono::microseconds grow_delay{ 10000 };
+    // 每次增加的线程数，0为当前线程数（加倍）
+    int grow_step = 0;
+    // 连续满足增加条件的间隔数
+    size_t grow_hold = 1;
+    // 任务队列为空且线程利用率低于阈值时减少线程
+    double shrink_utilization = 0.5;
+    int shrink_step = 1;
+    // 连续满足减少条件的间隔数
+    size_t shrink_hold = 10;
+    // 保留的调整记录数
+    size_t history = 64;
+    // 每次调整后在控制线程中调用，不能在回调中停止自动调整
+    ::std::function<void(const autoscale_decision&)> on_decision;
+};
+
+// 线程预算的配置
+struct budget_config
+{
+    // 所有线程池的线程总数，0为逻辑CPU数
+    int total_threads = 0;
+    // 分配间隔，每个间隔采样8次各线程池需要的线程数
+    ::std::chrono::milliseconds interval{ 100 };
+    // 减少线程数须连续满足的间隔数，收回借出的线程时不等待
+    size_t shrink_hold = 10;
+};
+
+// 线程池在线程预算中的份额：按权重保证的线程数限制在最小、最大线程数之间
+struct budget_share
+{
+    double weight = 1.0;
+    int min_threads = 1;
+    // 0为预算的线程总数
+    int max_threads = 0;
+};
+
+// 线程池在线程预算中的分配结果; thread_number大于guaranteed时为借入，小于时为借出
+struct budget_allocation
+{
+    const void* pool;
+    budget_share share;
+    // 分配的线程数
+    int thread_number;
+    // 按权重保证的线程数
+    int guaranteed;
+    // 需要的线程数：调整间隔内正在运行和排队的任务数的最大值，限制在最小、最大线程数之间
+    int demand;
+    // 暂停、退出流程中的线程池不参与分配
+    bool active;
+};
+
+
+// 可以取消的函数对象的基类：派生类提供is_cancelled() const，任务对象在运行前检查
+struct cancellable_tag
+{
+};
+
+// 任务分配器统计
+struct arena_statistics
+{
+    size_t allocations;         // 分配的块数（包括大块）
+    size_t deallocations;       // 释放的块数（包括大块）
+    size_t remote_frees;        // 在其他线程释放的块数
+    size_t remote_batches;      // 批量归还给所属线程的次数
+    size_t slab_allocations;    // 向系统申请缓存块的次数
+    size_t large_allocations;   // 直接向系统申请的次数（未启用缓存槽或超过最大块大小）
+    size_t reserved_bytes;      // 缓存块占用的内存
+};
+
+/* 任务分配器：任务对象的堆存储和future共享状态的分配入口，进程内所有线程池共享
+*  默认直接向系统申请; set_enabled(true)后从每个线程的缓存槽分配，稳定状态下不调用malloc
+*  每个缓存槽按大小分类保存空闲块，空闲块用尽时从自己的缓存块（64KB）切分
+*  在其他线程释放的块先保存在释放线程的缓存槽中，每32个或线程退出时无锁归还给所属缓存槽; 缓存块不归还系统
+**/
+class task_arena
+{
+public:
+    static const size_t alignment = 16;     // 分配的内存对齐
+    static const size_t max_size = 1008;    // 从缓存槽分配的最大字节数，更大的直接向系统申请
+
+    SYSCONAPI static void* allocate(size_t size);
+    SYSCONAPI static void deallocate(void* ptr);
+    SYSCONAPI static arena_statistics get_statistics();
+    // 启用或停用缓存槽，只影响之后的分配，已分配的块可以在任意状态下释放
+    SYSCONAPI static void set_enabled(bool enabled);
+    SYSCONAPI static bool is_enabled();
+};
+
+// 使用task_arena的分配器，用于future共享状态
+template<class T> class arena_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<class U> struct rebind
+    {
+        typedef arena_allocator<U> other;
+    };
+
+    arena_allocator(){}
+    template<class U> arena_allocator(const arena_allocator<U>&){}
+    T* allocate(size_t n)
+    {
+        static_assert(::std::alignment_of<T>::value <= task_arena::alignment, "arena_allocator does not support over-aligned types");
+        return static_cast<T*>(task_arena::allocate(n * sizeof(T)));
     }
-    void notify(size_t attach_tasks_number)
-    { // 最多通知3个线程
-        auto&& i = auto_min(3UL, (size_t)m_thread_started.load(), attach_tasks_number);
-        while (i--)
-            notify();
+    void deallocate(T* ptr, size_t)
+    {
+        task_arena::deallocate(ptr);
+    }
+    template<class U, class... Args> void construct(U* ptr, Args&&... args)
+    {
+        ::new ((void*)ptr) U(::std::forward<Args>(args)...);
     }
+    template<class U> void destroy(U* ptr)
+    {
+        ptr->~U();
+    }
+    size_t max_size() const
+    {
+        return (size_t)-1 / sizeof(T);
+    }
+};
+template<class T, class U> inline bool operator==(const arena_allocator<T>&, const arena_allocator<U>&)
+{
+    return true;
+}
+template<class T, class U> inline bool operator!=(const arena_allocator<T>&, const arena_allocator<U>&)
+{
+    return false;
+}
+
+// 任务对象：只能移动，可以保存只能移动的函数对象。小对象直接存储在对象内部，大对象从task_arena分配
+class task_object
+{
+private:
+    // 内部存储空间大小
+    static const size_t buffer_size = 6 * sizeof(void*);
+    typedef typename ::std::aligned_storage<buffer_size>::type storage_type;
 
-    // 获取任务队列中的任务，返回当前任务和未执行任务总数
-    ::std::pair<::std::function<void()>, size_t> get_task()
+    // 函数对象操作表，不使用虚函数
+    struct operation_table
     {
-        ::std::function<void()> task;
-        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
-        size_t task_num = m_tasks.size();
-        if (task_num)
+        void(*invoke)(storage_type& storage);
+        void(*move)(storage_type& dst, storage_type& src); // 移动构造dst并析构src
+        void(*destroy)(storage_type& storage);
+        const ::std::type_info& (*type)();
+        bool(*cancelled)(storage_type& storage); // 不能取消的函数对象为nullptr
+    };
+    // 存储在对象内部的函数对象
+    template<class Fn> struct local_operation
+    {
+        static Fn& get(storage_type& storage){ return *reinterpret_cast<Fn*>(&storage); }
+        static void invoke(storage_type& storage){ get(storage)(); }
+        static void move(storage_type& dst, storage_type& src)
         {
-            ::std::swap(task, m_tasks.front());
-            m_tasks.pop_front();
-            lck.unlock();
-            return ::std::make_pair(::std::move(task), task_num);
+            ::new (&dst) Fn(::std::move(get(src)));
+            get(src).~Fn();
         }
-        else
+        static void destroy(storage_type& storage){ get(storage).~Fn(); }
+        static const ::std::type_info& type(){ return typeid(Fn); }
+        static bool cancelled(storage_type& storage){ return get(storage).is_cancelled(); }
+        static bool(*cancelled_entry(::std::true_type))(storage_type&){ return cancelled; }
+        static bool(*cancelled_entry(::std::false_type))(storage_type&){ return nullptr; }
+        static const operation_table* table()
         {
-            lck.unlock();
-            return ::std::make_pair(::std::move(task), 0);
+            static const operation_table value = { invoke, move, destroy, type, cancelled_entry(::std::is_base_of<cancellable_tag, Fn>()) };
+            return &value;
+        }
+    };
+    // 存储在堆上的函数对象，从task_arena分配
+    template<class Fn> struct heap_operation
+    {
+        static Fn*& get(storage_type& storage){ return *reinterpret_cast<Fn**>(&storage); }
+        static void invoke(storage_type& storage){ (*get(storage))(); }
+        static void move(storage_type& dst, storage_type& src)
+        {
+            ::new (&dst) Fn*(get(src));
+            get(src) = nullptr;
+        }
+        static void destroy(storage_type& storage)
+        {
+            auto fn = get(storage);
+            if (fn)
+            {
+                fn->~Fn();
+                task_arena::deallocate(fn);
+            }
+        }
+        static const ::std::type_info& type(){ return typeid(Fn); }
+        static bool cancelled(storage_type& storage){ return get(storage)->is_cancelled(); }
+        static bool(*cancelled_entry(::std::true_type))(storage_type&){ return cancelled; }
+        static bool(*cancelled_entry(::std::false_type))(storage_type&){ return nullptr; }
+        static const operation_table* table()
+        {
+            static const operation_table value = { invoke, move, destroy, type, cancelled_entry(::std::is_base_of<cancellable_tag, Fn>()) };
+            return &value;
+        }
+    };
+    template<class Fn> struct is_local : ::std::integral_constant<bool,
+        sizeof(Fn) <= sizeof(storage_type) && ::std::alignment_of<storage_type>::value % ::std::alignment_of<Fn>::value == 0 &&
+        ::std::is_nothrow_move_constructible<Fn>::value>
+    {
+    };
+
+    template<class Fn> void construct(Fn&& fn, ::std::true_type /*is_local*/)
+    {
+        typedef typename ::std::decay<Fn>::type function_type;
+        ::new (&m_storage) function_type(::std::forward<Fn>(fn));
+        m_table = local_operation<function_type>::table();
+    }
+    template<class Fn> void construct(Fn&& fn, ::std::false_type /*is_local*/)
+    {
+        typedef typename ::std::decay<Fn>::type function_type;
+        static_assert(::std::alignment_of<function_type>::value <= task_arena::alignment, "task_object does not support over-aligned function objects");
+        void* ptr = task_arena::allocate(sizeof(function_type));
+        try
+        {
+            ::new (&m_storage) function_type*(::new (ptr) function_type(::std::forward<Fn>(fn)));
+        }
+        catch (...)
+        {
+            task_arena::deallocate(ptr);
+            throw;
         }
+        m_table = heap_operation<function_type>::table();
     }
-    // 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]
-    bool run_task(::std::pair<::std::function<void()>, size_t>&& task_val);
 
-    // 设置新的处理线程数，退出流程和未初始化的线程池则失败，线程启动时先执行一次启动函数
-    SYSCONAPI bool _set_new_thread_number(int thread_number_new, ::std::function<void()>&& startup_fn);
+    storage_type m_storage;
+    const operation_table* m_table = nullptr;
+#ifdef THREADPOOL_HISTOGRAM
+    // 添加到任务队列的时间（纳秒）
+    long long m_enqueue_time = 0;
+#endif
 
 public:
-    // 标准线程结束代码
-    static const size_t success_code = 0x00001000;
-
-    threadpool(){}
-    threadpool(int thread_number){ set_thread_number(thread_number); }
-    // 线程启动时先执行一次启动函数
-    template<class Fn, class... Args> threadpool(int thread_number, Fn&& startup_fn, Args&&... args)
+    task_object() = default;
+    template<class Fn, class = typename ::std::enable_if<!::std::is_same<typename ::std::decay<Fn>::type, task_object>::value>::type>
+    task_object(Fn&& fn)
     {
-        set_thread_number(thread_number, ::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...);
+        construct(::std::forward<Fn>(fn), is_local<typename ::std::decay<Fn>::type>());
+    }
+    ~task_object()
+    {
+        reset();
     }
-    SYSCONAPI ~threadpool();
     // 复制构造函数
-    threadpool(const threadpool&) = delete;
+    task_object(const task_object&) = delete;
     // 复制赋值语句
-    threadpool& operator=(const threadpool&) = delete;
+    task_object& operator=(const task_object&) = delete;
     // 移动构造函数
-    threadpool(threadpool&&) = delete;
-    // 移动赋值语句
-    threadpool& operator=(threadpool&&) = delete;
-
-    // 启动暂停pause的线程
-    bool start()
+    task_object(task_object&& other)
     {
-        // 任务队列读写锁
-        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-        switch (m_exit_event.load())
+#ifdef THREADPOOL_HISTOGRAM
+        m_enqueue_time = other.m_enqueue_time;
+#endif
+        if (other.m_table)
         {
-        case exit_event_t::PAUSE:
-            m_exit_event = exit_event_t::NORMAL;
-            ::std::swap(m_tasks, m_pause_tasks);
-            m_push_tasks = &m_tasks;
-            lck.unlock();
-            notify(m_tasks.size());
-            assert(m_pause_tasks.size() == 0);
-        case exit_event_t::NORMAL:
-            return true;
-            // 退出流程中禁止操作线程控制事件
-        case exit_event_t::INITIALIZATION:
-        default:
-            return false;
+            other.m_table->move(m_storage, other.m_storage);
+            m_table = other.m_table;
+            other.m_table = nullptr;
         }
     }
-    // 暂停线程执行，直到退出stop或者启动start
-    bool pause()
+    // 移动赋值语句
+    task_object& operator=(task_object&& other)
     {
-        // 任务队列读写锁
-        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-        switch (m_exit_event.load())
+        if (this != &other)
         {
-        case exit_event_t::NORMAL:
-            m_exit_event = exit_event_t::PAUSE;
-            ::std::swap(m_tasks, m_pause_tasks);
-            m_push_tasks = &m_pause_tasks;
-            lck.unlock();
-            assert(m_tasks.size() == 0);
-        case exit_event_t::PAUSE:
-            return true;
-        case exit_event_t::INITIALIZATION:
-        default: // 退出流程中禁止操作线程控制事件
-            return false;
+            reset();
+#ifdef THREADPOOL_HISTOGRAM
+            m_enqueue_time = other.m_enqueue_time;
+#endif
+            if (other.m_table)
+            {
+                other.m_table->move(m_storage, other.m_storage);
+                m_table = other.m_table;
+                other.m_table = nullptr;
+            }
         }
+        return *this;
     }
-    // 立即结束任务，未处理的任务将丢弃
-    void stop()
+
+    // 执行任务
+    void operator()()
     {
-        switch (m_exit_event.load())
-        {
-        case exit_event_t::NORMAL:
-        case exit_event_t::WAIT_TASK_COMPLETE:
-            // 任务队列读写锁
-            m_task_lock.lock();
-            ::std::swap(m_tasks, m_pause_tasks);
-            m_push_tasks = &m_pause_tasks;
-            m_task_lock.unlock();
-            assert(m_tasks.size() == 0);
-        case exit_event_t::PAUSE:
-            m_exit_event = exit_event_t::STOP_IMMEDIATELY;
-            ::SetEvent(m_stop_thread);
-        case exit_event_t::INITIALIZATION:
-        default:
-            break;
-        }
+        m_table->invoke(m_storage);
     }
-    // 当任务队列执行完毕后退出线程，如果线程池正在退出则失败
-    bool stop_on_completed()
+    // 是否保存有任务
+    explicit operator bool() const
     {
-        switch (m_exit_event.load())
-        {
-        case exit_event_t::PAUSE:
-            start();
-        case exit_event_t::NORMAL:
-            m_exit_event = exit_event_t::WAIT_TASK_COMPLETE;
-            ::SetEvent(m_stop_thread);
-        case exit_event_t::WAIT_TASK_COMPLETE:
-            return true;
-        case exit_event_t::INITIALIZATION:
-        default:
-            return false;
-        }
+        return !!m_table;
     }
-
-    // 添加一个任务
-    template<class Fn, class... Args> bool push(Fn&& fn, Args&&... args)
+    // 清空任务
+    void reset()
     {
-        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
-        switch (m_exit_event.load())
+        if (m_table)
         {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
-            return false;
+            m_table->destroy(m_storage);
+            m_table = nullptr;
         }
-        // 绑定函数
-        auto task_obj = ::std::make_shared<decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))>(
-            ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
-        // 生成任务（仿函数）
-        ::std::function<void()> bind_function(::std::bind(function_wapper(), ::std::move(task_obj)));
-        // 任务队列读写锁
-        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-        m_push_tasks->push_back(::std::move(bind_function));
-        lck.unlock();
-        m_task_all++;
-        notify();
-        return true;
     }
-    // 添加一个任务并返回返回值对象pair<future,bool>，使用future::get获取返回值（若未完成会等待完成）
-    template<class Fn, class... Args> auto push_future(Fn&& fn, Args&&... args)
-        -> ::std::pair<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    // 获取保存的函数对象类型
+    const ::std::type_info& target_type() const
     {
-        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
-        ::std::future<result_type> future_obj;
-        switch (m_exit_event.load())
-        {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
+        return m_table ? m_table->type() : typeid(void);
+    }
+    // 任务是否已取消，只有从cancellable_tag派生的函数对象可以取消
+    bool is_cancelled() const
+    {
+        return m_table && m_table->cancelled && m_table->cancelled(const_cast<storage_type&>(m_storage));
+    }
+#ifdef THREADPOOL_HISTOGRAM
+    // 设置和获取添加到任务队列的时间（纳秒），0表示没有记录
+    void set_enqueue_time(long long time)
+    {
+        m_enqueue_time = time;
+    }
+    long long get_enqueue_time() const
+    {
+        return m_enqueue_time;
+    }
+#endif
+};
+
+// 抛出异常的任务记录：任务、捕获的异常和运行次数（包括自动重试）
+struct task_failure
+{
+    task_object task;
+    ::std::exception_ptr exception;
+    size_t attempts;
+
+    task_failure(task_object&& task_arg, ::std::exception_ptr exception_arg, size_t attempts_arg)
+        : task(::std::move(task_arg)), exception(::std::move(exception_arg)), attempts(attempts_arg){}
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // VS2012,VS2013不会生成移动构造函数
+    task_failure(task_failure&& other) : task(::std::move(other.task)), exception(::std::move(other.exception)), attempts(other.attempts){}
+    task_failure& operator=(task_failure&& other)
+    {
+        task = ::std::move(other.task);
+        exception = ::std::move(other.exception);
+        attempts = other.attempts;
+        return *this;
+    }
+#endif // #if _MSC_VER <= 1800
+};
+
+
+#ifdef THREADPOOL_HISTOGRAM
+// 直方图快照：桶按对数-线性划分，每个2的幂区间分为32个桶，记录的值相对误差不超过1/32; 时间单位为纳秒
+struct histogram_snapshot
+{
+    // 各桶计数，为空表示没有记录
+    ::std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+
+    // 获取百分位数（0-100）对应的值，返回所在桶的上界且不超过最大值
+    ::std::chrono::nanoseconds percentile(double p) const;
+    // 获取平均值、最小值、最大值
+    ::std::chrono::nanoseconds mean() const
+    {
+        return ::std::chrono::nanoseconds(count ? (long long)(sum / count) : 0);
+    }
+    ::std::chrono::nanoseconds minimum() const
+    {
+        return ::std::chrono::nanoseconds((long long)min);
+    }
+    ::std::chrono::nanoseconds maximum() const
+    {
+        return ::std::chrono::nanoseconds((long long)max);
+    }
+    // 合并另一个快照
+    void merge(const histogram_snapshot& other)
+    {
+        if (!other.count)
+            return;
+        if (counts.size() < other.counts.size())
+            counts.resize(other.counts.size());
+        for (size_t i = 0; i < other.counts.size(); i++)
+            counts[i] += other.counts[i];
+        min = count ? ::std::min(min, other.min) : other.min;
+        max = ::std::max(max, other.max);
+        count += other.count;
+        sum += other.sum;
+    }
+};
+
+// 无锁延迟直方图：记录只使用relaxed原子加法，快照和记录同时进行时各计数之间可能有少量偏差
+class latency_histogram
+{
+public:
+    // 每个2的幂区间的桶数为2^sub_bits
+    static const unsigned sub_bits = 5;
+    static const uint64_t sub_count = 1ULL << sub_bits;
+    // 记录的最大值为2^max_bits-1纳秒（约18分钟），更大的值记录在最后一个桶
+    static const unsigned max_bits = 40;
+    static const size_t bucket_count = (size_t)(max_bits - sub_bits + 1) << sub_bits;
+
+    // 值所在的桶序号
+    static size_t bucket_index(uint64_t value)
+    {
+        if (value >= (1ULL << max_bits))
+            value = (1ULL << max_bits) - 1;
+        if (value < sub_count)
+            return (size_t)value;
+        unsigned shift = highest_bit(value) - sub_bits;
+        return ((size_t)(shift + 1) << sub_bits) + (size_t)((value >> shift) - sub_count);
+    }
+    // 桶中记录的最大值
+    static uint64_t bucket_upper(size_t index)
+    {
+        if (index < sub_count)
+            return index;
+        unsigned shift = (unsigned)(index >> sub_bits) - 1;
+        uint64_t mantissa = (index & (sub_count - 1)) + sub_count;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+private:
+    ::std::atomic<uint64_t> m_counts[bucket_count];
+    ::std::atomic<uint64_t> m_count;
+    ::std::atomic<uint64_t> m_sum;
+    ::std::atomic<uint64_t> m_min;
+    ::std::atomic<uint64_t> m_max;
+
+    static unsigned highest_bit(uint64_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+#if defined(_WIN64)
+        _BitScanReverse64(&index, value);
+#else
+        if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+            return index + 32;
+        _BitScanReverse(&index, (unsigned long)value);
+#endif
+        return index;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+public:
+    latency_histogram()
+    {
+        reset();
+    }
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    // 记录一个值（纳秒），负值记为0
+    void record(long long value)
+    {
+        uint64_t val = value > 0 ? (uint64_t)value : 0;
+        m_counts[bucket_index(val)].fetch_add(1, ::std::memory_order_relaxed);
+        m_count.fetch_add(1, ::std::memory_order_relaxed);
+        m_sum.fetch_add(val, ::std::memory_order_relaxed);
+        auto current = m_min.load(::std::memory_order_relaxed);
+        while (val < current && !m_min.compare_exchange_weak(current, val, ::std::memory_order_relaxed))
+            ;
+        current = m_max.load(::std::memory_order_relaxed);
+        while (val > current && !m_max.compare_exchange_weak(current, val, ::std::memory_order_relaxed))
+            ;
+    }
+    // 清空记录
+    void reset()
+    {
+        for (auto& val : m_counts)
+            val.store(0, ::std::memory_order_relaxed);
+        m_count.store(0, ::std::memory_order_relaxed);
+        m_sum.store(0, ::std::memory_order_relaxed);
+        m_min.store(UINT64_MAX, ::std::memory_order_relaxed);
+        m_max.store(0, ::std::memory_order_relaxed);
+    }
+    // 合并到快照
+    void snapshot(histogram_snapshot& result) const
+    {
+        histogram_snapshot value;
+        value.count = m_count.load(::std::memory_order_relaxed);
+        if (!value.count)
+            return;
+        value.counts.resize(bucket_count);
+        for (size_t i = 0; i < bucket_count; i++)
+            value.counts[i] = m_counts[i].load(::std::memory_order_relaxed);
+        value.sum = m_sum.load(::std::memory_order_relaxed);
+        value.min = m_min.load(::std::memory_order_relaxed);
+        value.max = m_max.load(::std::memory_order_relaxed);
+        if (value.min > value.max)
+            value.min = value.max;
+        result.merge(value);
+    }
+};
+
+inline ::std::chrono::nanoseconds histogram_snapshot::percentile(double p) const
+{
+    uint64_t total = 0;
+    for (auto val : counts)
+        total += val;
+    if (!total)
+        return ::std::chrono::nanoseconds(0);
+    p = ::std::min(::std::max(p, 0.0), 100.0);
+    auto rank = ::std::max<uint64_t>((uint64_t)(p / 100.0 * (double)total + 0.5), 1);
+    uint64_t current = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        current += counts[i];
+        if (current >= rank)
+            return ::std::chrono::nanoseconds((long long)::std::min(latency_histogram::bucket_upper(i), max));
+    }
+    return maximum();
+}
+
+// 任务排队延迟（添加到任务队列到开始运行）和运行时间直方图快照
+struct task_histogram_snapshot
+{
+    histogram_snapshot queue_delay;
+    histogram_snapshot execution;
+    void merge(const task_histogram_snapshot& other)
+    {
+        queue_delay.merge(other.queue_delay);
+        execution.merge(other.execution);
+    }
+};
+
+// 任务排队延迟和运行时间直方图
+struct task_histogram
+{
+    latency_histogram queue_delay;
+    latency_histogram execution;
+    void snapshot(task_histogram_snapshot& result) const
+    {
+        queue_delay.snapshot(result.queue_delay);
+        execution.snapshot(result.execution);
+    }
+    void reset()
+    {
+        queue_delay.reset();
+        execution.reset();
+    }
+};
+
+// 按任务对象类型统计的直方图表：无锁开放寻址，类型只增不删，表满后新类型不再统计
+class type_histogram_table
+{
+private:
+    static const size_t capacity = 64;
+    struct entry
+    {
+        ::std::atomic<const ::std::type_info*> type{ nullptr };
+        ::std::atomic<task_histogram*> histogram{ nullptr };
+    };
+    entry m_entries[capacity];
+
+public:
+    type_histogram_table() = default;
+    type_histogram_table(const type_histogram_table&) = delete;
+    type_histogram_table& operator=(const type_histogram_table&) = delete;
+    ~type_histogram_table()
+    {
+        for (auto& val : m_entries)
+            delete val.histogram.load();
+    }
+
+    // 查找或添加类型的直方图，表满或其他线程正在添加时返回nullptr
+    task_histogram* find(const ::std::type_info& type)
+    {
+        auto hash = type.hash_code();
+        for (size_t i = 0; i < capacity; i++)
+        {
+            auto& val = m_entries[(hash + i) % capacity];
+            auto current = val.type.load(::std::memory_order_acquire);
+            if (!current)
+            {
+                if (val.type.compare_exchange_strong(current, &type, ::std::memory_order_acq_rel))
+                {
+                    auto result = new task_histogram;
+                    val.histogram.store(result, ::std::memory_order_release);
+                    return result;
+                }
+            }
+            if (current == &type || *current == type)
+                return val.histogram.load(::std::memory_order_acquire);
+        }
+        return nullptr;
+    }
+    // 获取所有类型的快照（类型名称由type_info::name提供）
+    void snapshot(::std::vector<::std::pair<::std::string, task_histogram_snapshot>>& result) const
+    {
+        for (auto& val : m_entries)
+        {
+            auto histogram = val.histogram.load(::std::memory_order_acquire);
+            if (!histogram)
+                continue;
+            ::std::string name = val.type.load(::std::memory_order_acquire)->name();
+            auto iter = ::std::find_if(result.begin(), result.end(),
+                [&name](const ::std::pair<::std::string, task_histogram_snapshot>& item){ return item.first == name; });
+            if (iter == result.end())
+            {
+                result.emplace_back(name, task_histogram_snapshot());
+                iter = result.end() - 1;
+            }
+            histogram->snapshot(iter->second);
+        }
+    }
+    void reset()
+    {
+        for (auto& val : m_entries)
+        {
+            auto histogram = val.histogram.load(::std::memory_order_acquire);
+            if (histogram)
+                histogram->reset();
+        }
+    }
+};
+#endif // #ifdef THREADPOOL_HISTOGRAM
+
+
+// 取消令牌：可以复制，和创建它的cancellation_source共享取消状态; 默认构造的令牌不会被取消
+class cancellation_token
+{
+private:
+    ::std::shared_ptr<::std::atomic<bool>> m_state;
+
+public:
+    cancellation_token() = default;
+    explicit cancellation_token(const ::std::shared_ptr<::std::atomic<bool>>& state) : m_state(state){}
+    bool is_cancelled() const
+    {
+        return m_state && m_state->load(::std::memory_order_acquire);
+    }
+    // 是否可以被取消
+    bool can_be_cancelled() const
+    {
+        return !!m_state;
+    }
+};
+
+// 取消源：可以复制，取消后所有令牌同时变为已取消，不能恢复
+class cancellation_source
+{
+private:
+    ::std::shared_ptr<::std::atomic<bool>> m_state;
+
+public:
+    cancellation_source() : m_state(::std::make_shared<::std::atomic<bool>>(false)){}
+    cancellation_token get_token() const
+    {
+        return cancellation_token(m_state);
+    }
+    // 取消，返回是否由此次调用取消
+    bool cancel()
+    {
+        return !m_state->exchange(true, ::std::memory_order_acq_rel);
+    }
+    bool is_cancelled() const
+    {
+        return m_state->load(::std::memory_order_acquire);
+    }
+};
+
+// 带取消令牌的任务：工作线程取出任务后检查令牌，已取消时不运行
+template<class Fn> class cancellable_task : public cancellable_tag
+{
+private:
+    cancellation_token m_token;
+    Fn m_fn;
+
+public:
+    template<class F> cancellable_task(const cancellation_token& token, F&& fn) : m_token(token), m_fn(::std::forward<F>(fn)){}
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // VS2012,VS2013不会生成移动构造函数
+    cancellable_task(cancellable_task&& other) : m_token(::std::move(other.m_token)), m_fn(::std::move(other.m_fn)){}
+#endif // #if _MSC_VER <= 1800
+    bool is_cancelled() const
+    {
+        return m_token.is_cancelled();
+    }
+    void operator()()
+    {
+        m_fn();
+    }
+};
+template<class Fn> cancellable_task<typename ::std::decay<Fn>::type> make_cancellable_task(const cancellation_token& token, Fn&& fn)
+{
+    return cancellable_task<typename ::std::decay<Fn>::type>(token, ::std::forward<Fn>(fn));
+}
+
+// 定时任务的共享状态：到期时运行的任务、取消状态，周期任务同时只有一次在任务队列中或正在运行
+class timer_state
+{
+public:
+    enum status_t { waiting, started, cancelled };
+    // 清除pending标记的删除器，不释放状态
+    struct release_pending
+    {
+        void operator()(timer_state* state) const
+        {
+            state->m_pending.store(false);
+        }
+    };
+
+private:
+    task_object m_task;
+    bool m_periodic;
+    // 一次性任务：waiting->started或waiting->cancelled; 周期任务：waiting->cancelled
+    ::std::atomic<int> m_status{ waiting };
+    // 已添加到任务队列、尚未运行结束
+    ::std::atomic<bool> m_pending{ false };
+    ::std::atomic<size_t> m_run_number{ 0 };
+
+public:
+    timer_state(task_object&& task, bool periodic) : m_task(::std::move(task)), m_periodic(periodic){}
+    timer_state(const timer_state&) = delete;
+    timer_state& operator=(const timer_state&) = delete;
+
+    // 运行任务，已取消或一次性任务已运行时跳过
+    void run()
+    {
+        if (m_periodic)
+        {
+            if (m_status.load() == cancelled)
+                return;
+        }
+        else
+        {
+            int expected = waiting;
+            if (!m_status.compare_exchange_strong(expected, started))
+                return;
+        }
+        m_run_number++;
+        m_task();
+    }
+    /* 取消，返回是否由此次调用取消：一次性任务开始运行后不能取消，周期任务正在运行的一次不受影响
+    *  一次性任务取消后不会再运行，立即释放任务（包括捕获的对象）
+    **/
+    bool cancel()
+    {
+        int expected = waiting;
+        if (!m_status.compare_exchange_strong(expected, cancelled))
+            return false;
+        if (!m_periodic)
+            m_task = task_object();
+        return true;
+    }
+    bool is_cancelled() const
+    {
+        return m_status.load() == cancelled;
+    }
+    bool is_periodic() const
+    {
+        return m_periodic;
+    }
+    size_t get_run_number() const
+    {
+        return m_run_number.load();
+    }
+    // 标记已添加到任务队列，已标记时返回false
+    bool set_pending()
+    {
+        return !m_pending.exchange(true);
+    }
+};
+
+// 添加到线程池的定时任务：运行结束或未运行就被销毁时清除pending标记; 取出时已取消的不运行，计入取消任务数
+class timer_task : public cancellable_tag
+{
+private:
+    ::std::shared_ptr<timer_state> m_state;
+    ::std::unique_ptr<timer_state, timer_state::release_pending> m_pending;
+
+public:
+    timer_task(const ::std::shared_ptr<timer_state>& state) : m_state(state), m_pending(state.get()){}
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // VS2012,VS2013不会生成移动构造函数
+    timer_task(timer_task&& other) : m_state(::std::move(other.m_state)), m_pending(::std::move(other.m_pending)){}
+#endif // #if _MSC_VER <= 1800
+    void operator()()
+    {
+        auto pending = ::std::move(m_pending); // 运行结束（包括抛出异常）时清除
+        m_state->run();
+    }
+    bool is_cancelled() const
+    {
+        return m_state->is_cancelled();
+    }
+};
+
+// 定时任务句柄：可以复制，用于取消和查询定时任务
+class timer_handle
+{
+private:
+    ::std::shared_ptr<timer_state> m_state;
+
+public:
+    timer_handle() = default;
+    explicit timer_handle(const ::std::shared_ptr<timer_state>& state) : m_state(state){}
+    bool valid() const
+    {
+        return !!m_state;
+    }
+    // 取消定时任务，返回是否由此次调用取消; 一次性任务开始运行后返回false
+    bool cancel()
+    {
+        return m_state && m_state->cancel();
+    }
+    bool is_cancelled() const
+    {
+        return m_state && m_state->is_cancelled();
+    }
+    bool is_periodic() const
+    {
+        return m_state && m_state->is_periodic();
+    }
+    // 获取已运行的次数
+    size_t get_run_number() const
+    {
+        return m_state ? m_state->get_run_number() : 0;
+    }
+};
+
+// 定时器队列中的定时任务，按到期时间组成最小堆
+struct timer_entry
+{
+    ::std::chrono::steady_clock::time_point due;
+    // 周期，0为一次性任务
+    ::std::chrono::steady_clock::duration period;
+    ::std::shared_ptr<timer_state> state;
+    // 堆比较函数（反向）：std::push_heap等按此比较时，到期时间最早的在堆顶
+    bool operator<(const timer_entry& other) const
+    {
+        return due > other.due;
+    }
+};
+
+
+// 工作窃取队列（Chase-Lev），只有所有者线程可以push/pop，其他线程可以steal; T必须为指针类型
+template<class T> class work_stealing_deque
+{
+private:
+    struct array_t
+    {
+        int64_t capacity;
+        ::std::unique_ptr<::std::atomic<T>[]> buffer;
+        array_t(int64_t capacity_arg) : capacity(capacity_arg), buffer(new ::std::atomic<T>[(size_t)capacity_arg]){}
+        T get(int64_t index) const { return buffer[(size_t)(index & (capacity - 1))].load(::std::memory_order_relaxed); }
+        void put(int64_t index, T value){ buffer[(size_t)(index & (capacity - 1))].store(value, ::std::memory_order_relaxed); }
+    };
+    ::std::atomic<int64_t> m_top{ 0 };
+    ::std::atomic<int64_t> m_bottom{ 0 };
+    ::std::atomic<array_t*> m_array;
+    // 扩容后的旧数组，窃取线程可能仍在读取，析构时释放
+    ::std::vector<::std::unique_ptr<array_t>> m_arrays;
+
+    array_t* grow(array_t* old_array, int64_t bottom, int64_t top)
+    {
+        m_arrays.emplace_back(new array_t(old_array->capacity * 2));
+        auto new_array = m_arrays.back().get();
+        for (auto i = top; i < bottom; i++)
+            new_array->put(i, old_array->get(i));
+        m_array.store(new_array, ::std::memory_order_release);
+        return new_array;
+    }
+
+public:
+    static_assert(::std::is_pointer<T>::value, "work_stealing_deque element must be a pointer");
+    work_stealing_deque(int64_t capacity = 64)
+    {
+        assert(capacity > 0 && !(capacity & (capacity - 1))); // Capacity must be power of 2
+        m_arrays.emplace_back(new array_t(capacity));
+        m_array.store(m_arrays.back().get(), ::std::memory_order_relaxed);
+    }
+    work_stealing_deque(const work_stealing_deque&) = delete;
+    work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+    // 所有者线程：添加到队列底部
+    void push(T value)
+    {
+        auto bottom = m_bottom.load(::std::memory_order_relaxed);
+        auto top = m_top.load(::std::memory_order_acquire);
+        auto array = m_array.load(::std::memory_order_relaxed);
+        if (bottom - top > array->capacity - 1)
+            array = grow(array, bottom, top);
+        array->put(bottom, value);
+        ::std::atomic_thread_fence(::std::memory_order_release);
+        m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+    }
+    // 所有者线程：从队列底部取出
+    bool pop(T& value)
+    {
+        auto bottom = m_bottom.load(::std::memory_order_relaxed) - 1;
+        auto array = m_array.load(::std::memory_order_relaxed);
+        m_bottom.store(bottom, ::std::memory_order_relaxed);
+        ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+        auto top = m_top.load(::std::memory_order_relaxed);
+        bool result = true;
+        if (top <= bottom)
+        {
+            value = array->get(bottom);
+            if (top == bottom)
+            { // 最后一个元素，和窃取线程竞争
+                if (!m_top.compare_exchange_strong(top, top + 1, ::std::memory_order_seq_cst, ::std::memory_order_relaxed))
+                    result = false;
+                m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            result = false;
+            m_bottom.store(bottom + 1, ::std::memory_order_relaxed);
+        }
+        return result;
+    }
+    // 任意线程：从队列顶部窃取，竞争失败或队列为空返回false
+    bool steal(T& value)
+    {
+        auto top = m_top.load(::std::memory_order_acquire);
+        ::std::atomic_thread_fence(::std::memory_order_seq_cst);
+        auto bottom = m_bottom.load(::std::memory_order_acquire);
+        if (top < bottom)
+        {
+            auto array = m_array.load(::std::memory_order_acquire);
+            value = array->get(top);
+            return m_top.compare_exchange_strong(top, top + 1, ::std::memory_order_seq_cst, ::std::memory_order_relaxed);
+        }
+        return false;
+    }
+    // 队列中的元素数（估计值）
+    size_t size() const
+    {
+        auto bottom = m_bottom.load(::std::memory_order_relaxed);
+        auto top = m_top.load(::std::memory_order_relaxed);
+        return bottom > top ? (size_t)(bottom - top) : 0;
+    }
+    bool empty() const
+    {
+        return !size();
+    }
+};
+
+
+// 并行算法共享状态：引导式自调度领取索引区间（剩余越少区间越小），所有参与者共用一个完成计数器
+class parallel_state
+{
+private:
+    // 下一个未领取的索引
+    ::std::atomic<size_t> m_next{ 0 };
+    // 已完成的索引数
+    ::std::atomic<size_t> m_done{ 0 };
+    size_t m_count;
+    size_t m_grain;
+    size_t m_participants;
+    // 完成通知
+    ::std::mutex m_wait_lock;
+    ::std::condition_variable m_wait_cv;
+    // 第一个任务异常
+    ::std::atomic<bool> m_failed{ false };
+    ::std::exception_ptr m_exception;
+    spin_mutex m_exception_lock;
+
+public:
+    parallel_state(size_t count, size_t grain, size_t participants)
+        : m_count(count), m_grain(auto_max(grain, (size_t)1)), m_participants(auto_max(participants, (size_t)1)){}
+    parallel_state(const parallel_state&) = delete;
+    parallel_state& operator=(const parallel_state&) = delete;
+
+    // 领取区间[begin, end)，没有剩余索引时返回false
+    bool claim(size_t& begin, size_t& end)
+    {
+        auto next = m_next.load(::std::memory_order_relaxed);
+        size_t size;
+        do
+        {
+            if (next >= m_count)
+                return false;
+            auto remain = m_count - next;
+            size = auto_min(remain, auto_max(m_grain, remain / (m_participants * 2)));
+        } while (!m_next.compare_exchange_weak(next, next + size, ::std::memory_order_relaxed));
+        begin = next;
+        end = next + size;
+        return true;
+    }
+    // 参与者退出前提交完成的索引数，全部完成时唤醒等待的线程
+    void complete(size_t count)
+    {
+        if (count && m_done.fetch_add(count, ::std::memory_order_acq_rel) + count == m_count)
+        {
+            ::std::lock_guard<::std::mutex> lck(m_wait_lock);
+            m_wait_cv.notify_all();
+        }
+    }
+    // 等待所有索引完成
+    void wait()
+    {
+        if (m_done.load(::std::memory_order_acquire) == m_count)
+            return;
+        ::std::unique_lock<::std::mutex> lck(m_wait_lock);
+        m_wait_cv.wait(lck, [this]{ return m_done.load(::std::memory_order_acquire) == m_count; });
+    }
+    // 记录第一个异常，之后领取的区间不再执行
+    void set_exception(::std::exception_ptr exception)
+    {
+        ::std::lock_guard<spin_mutex> lck(m_exception_lock);
+        if (!m_exception)
+            m_exception = ::std::move(exception);
+        m_failed.store(true, ::std::memory_order_relaxed);
+    }
+    bool failed() const
+    {
+        return m_failed.load(::std::memory_order_relaxed);
+    }
+    // 所有索引完成后调用，有异常时重新抛出
+    void rethrow()
+    {
+        if (m_exception)
+            ::std::rethrow_exception(m_exception);
+    }
+};
+
+
+// 未运行就被销毁的任务的异常（std::future_errc::broken_promise）
+inline ::std::exception_ptr broken_promise_exception()
+{
+    ::std::future<void> future_obj;
+    {
+        ::std::promise<void> promise_obj;
+        future_obj = promise_obj.get_future();
+    }
+    try
+    {
+        future_obj.get();
+    }
+    catch (...)
+    {
+        return ::std::current_exception();
+    }
+    return nullptr;
+}
+
+/* 调度器的线程池句柄：线程池指针和添加任务的函数; 添加任务前增加posting再检查pool，
+*  线程池析构时先清空pool再等待posting为0，之后不会再访问线程池
+**/
+struct scheduler_handle
+{
+    ::std::atomic<void*> pool;
+    ::std::atomic<size_t> posting{ 0 };
+    // 添加任务，线程池在退出流程中时返回false，不移动任务
+    bool(*post)(void* pool, task_object& task);
+    scheduler_handle(void* pool_arg, bool(*post_arg)(void*, task_object&)) : pool(pool_arg), post(post_arg){}
+    bool try_post(task_object& task)
+    {
+        posting.fetch_add(1);
+        auto object = pool.load();
+        bool result = object && post(object, task);
+        posting.fetch_sub(1, ::std::memory_order_release);
+        return result;
+    }
+    // 线程池析构时调用：清空pool并等待正在添加的任务完成
+    void reset()
+    {
+        pool.store(nullptr);
+        while (posting.load())
+            ::std::this_thread::yield();
+    }
+};
+/* 任务调度器：共享线程池的句柄，可以比线程池生存更久（pool_future是值类型）;
+*  没有句柄、线程池已析构或者在退出流程中时在当前线程直接运行任务
+**/
+struct pool_scheduler
+{
+    ::std::shared_ptr<scheduler_handle> handle;
+    void operator()(task_object&& task) const
+    {
+        if (!handle || !handle->try_post(task))
+            task();
+    }
+};
+
+// 工作线程等待时帮助运行任务的上下文：所属线程池运行一条任务的函数、线程池对象和嵌套深度，工作线程启动时设置
+struct help_context
+{
+    static const size_t max_depth = 64; // 嵌套帮助运行的最大深度，超过后阻塞等待，避免栈溢出
+    bool(*run_one)(void* pool);
+    void* pool;
+    size_t depth;
+};
+// 当前线程的帮助运行上下文，非线程池线程的run_one为nullptr
+SYSCONAPI help_context& this_help_context();
+
+/* 等待fut就绪：在线程池的线程中调用时，等待期间运行所属线程池任务队列中的其他任务，
+*  避免所有线程阻塞等待自己线程池的任务而死锁; 其他线程直接阻塞等待。pool不为nullptr时只帮助该线程池
+**/
+template<class Future> void help_wait(const Future& fut, const void* pool = nullptr)
+{
+    auto& context = this_help_context();
+    if (!context.run_one || (pool && pool != context.pool) || context.depth >= help_context::max_depth)
+        return fut.wait();
+    context.depth++;
+    try
+    {
+        for (size_t idle = 0;;)
+        {
+            auto status = fut.wait_for(::std::chrono::seconds(0));
+            if (status == ::std::future_status::ready)
+                break;
+            if (status == ::std::future_status::deferred)
+            {
+                fut.wait(); // 延迟运行的任务在当前线程运行
+                break;
+            }
+            if (context.run_one(context.pool))
+            {
+                idle = 0;
+                continue;
+            }
+            // 没有可运行的任务时等待的任务正在其他线程运行，先让出CPU，再限时等待后重新检查任务队列
+            if (++idle < 16)
+                ::std::this_thread::yield();
+            else
+                fut.wait_for(::std::chrono::microseconds(100));
+        }
+    }
+    catch (...)
+    {
+        context.depth--;
+        throw;
+    }
+    context.depth--;
+}
+
+template<class T> class pool_future_state;
+template<class T, class Fn> class pool_future_task;
+template<class T, class Fn> class future_task;
+template<class T> class pool_future;
+template<class T> class bulk_state;
+template<class T, class Fn> class bulk_task;
+template<class T> class bulk_future;
+template<bool handle_exception = true, class lock_type = spin_mutex> class threadpool;
+
+#ifdef THREADPOOL_COROUTINE
+// 恢复协程的任务，未运行就被销毁（clear、stop、drop_oldest）时设置取消标记并恢复协程，不会泄漏协程帧
+class coroutine_resume_task
+{
+private:
+    ::std::coroutine_handle<> m_handle;
+    bool* m_cancelled;
+
+public:
+    coroutine_resume_task(::std::coroutine_handle<> handle, bool* cancelled) : m_handle(handle), m_cancelled(cancelled){}
+    coroutine_resume_task(coroutine_resume_task&& other) noexcept : m_handle(::std::exchange(other.m_handle, nullptr)), m_cancelled(other.m_cancelled){}
+    coroutine_resume_task(const coroutine_resume_task&) = delete;
+    coroutine_resume_task& operator=(const coroutine_resume_task&) = delete;
+    ~coroutine_resume_task()
+    {
+        if (m_handle)
+        {
+            *m_cancelled = true;
+            ::std::exchange(m_handle, nullptr).resume();
+        }
+    }
+    void operator()()
+    {
+        ::std::exchange(m_handle, nullptr).resume();
+    }
+    void release()
+    {
+        m_handle = nullptr;
+    }
+    // 是否已经不持有协程：已移动到任务对象、已运行或者已取消
+    bool released() const
+    {
+        return !m_handle;
+    }
+};
+
+// 协程结束时恢复等待它的协程（对称转移）
+struct coroutine_final_awaiter
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    template<class Promise> ::std::coroutine_handle<> await_suspend(::std::coroutine_handle<Promise> handle) noexcept
+    {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : ::std::noop_coroutine();
+    }
+    void await_resume() const noexcept
+    {
+    }
+};
+
+// 协程任务的promise公共部分：创建后挂起，直到被co_await或push_coroutine启动
+struct coroutine_promise_base
+{
+    ::std::coroutine_handle<> continuation;
+    ::std::exception_ptr exception;
+    ::std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+    coroutine_final_awaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+    void unhandled_exception() noexcept
+    {
+        exception = ::std::current_exception();
+    }
+};
+
+template<class T> struct coroutine_promise : coroutine_promise_base
+{
+    ::std::optional<T> value;
+    template<class U> void return_value(U&& result)
+    {
+        value.emplace(::std::forward<U>(result));
+    }
+    T get_result()
+    {
+        if (exception)
+            ::std::rethrow_exception(exception);
+        return ::std::move(*value);
+    }
+};
+template<> struct coroutine_promise<void> : coroutine_promise_base
+{
+    void return_void() const noexcept
+    {
+    }
+    void get_result()
+    {
+        if (exception)
+            ::std::rethrow_exception(exception);
+    }
+};
+
+// 协程任务：惰性启动，co_await时在当前线程启动并在完成时恢复等待的协程，挂起时不占用线程
+template<class T = void> class coroutine_task
+{
+public:
+    struct promise_type : coroutine_promise<T>
+    {
+        coroutine_task get_return_object()
+        {
+            return coroutine_task(::std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+private:
+    ::std::coroutine_handle<promise_type> m_handle;
+
+    explicit coroutine_task(::std::coroutine_handle<promise_type> handle) : m_handle(handle){}
+
+public:
+    coroutine_task() = default;
+    coroutine_task(coroutine_task&& other) noexcept : m_handle(::std::exchange(other.m_handle, nullptr)){}
+    coroutine_task& operator=(coroutine_task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = ::std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    coroutine_task(const coroutine_task&) = delete;
+    coroutine_task& operator=(const coroutine_task&) = delete;
+    ~coroutine_task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool valid() const
+    {
+        return !!m_handle;
+    }
+    bool done() const
+    {
+        return !m_handle || m_handle.done();
+    }
+
+    struct awaiter
+    {
+        ::std::coroutine_handle<promise_type> handle;
+        bool await_ready() const noexcept
+        {
+            return !handle || handle.done();
+        }
+        ::std::coroutine_handle<> await_suspend(::std::coroutine_handle<> caller) noexcept
+        {
+            handle.promise().continuation = caller;
+            return handle;
+        }
+        T await_resume()
+        {
+            return handle.promise().get_result();
+        }
+    };
+    awaiter operator co_await() const noexcept
+    {
+        return awaiter{ m_handle };
+    }
+};
+
+// 独立运行的协程，结束时自动销毁
+struct coroutine_detached
+{
+    struct promise_type
+    {
+        coroutine_detached get_return_object() const noexcept
+        {
+            return {};
+        }
+        ::std::suspend_never initial_suspend() const noexcept
+        {
+            return {};
+        }
+        ::std::suspend_never final_suspend() const noexcept
+        {
+            return {};
+        }
+        void return_void() const noexcept
+        {
+        }
+        void unhandled_exception() const noexcept
+        {
+            ::std::terminate();
+        }
+    };
+};
+
+template<class T, bool handle_exception, class lock_type> coroutine_detached coroutine_start(threadpool<handle_exception, lock_type>* pool, coroutine_task<T> task, ::std::shared_ptr<pool_future_state<T>> state);
+#endif // #ifdef THREADPOOL_COROUTINE
+
+
+/* 线程预算：进程内多个线程池共享的线程总数，仲裁线程按权重和最小、最大线程数分配各线程池的线程数，
+*  空闲线程池未使用的份额借给有排队任务的线程池，线程池需要时在下一个间隔收回; 线程池的接口、计数和暂停、停止行为不变
+*  加入预算的线程池不能同时自动调整线程数，预算对象须在加入的线程池之后销毁（线程池析构时自动退出预算）
+**/
+class worker_budget
+{
+private:
+    template<bool handle_exception, class lock_type> friend class threadpool;
+    // 线程池的采样：线程数、排队任务数、正在运行的任务数，是否正常运行
+    struct member_sample
+    {
+        int thread_number;
+        size_t queue_depth;
+        size_t running;
+        bool active;
+    };
+    // 加入预算的线程池，通过函数指针访问，不区分线程池类型
+    struct member
+    {
+        void* pool;
+        budget_share share;
+        void(*sample)(void* pool, member_sample& result);
+        bool(*resize)(void* pool, int thread_number);
+        void(*unbind)(void* pool);
+        // 分配间隔内需要的最大线程数、上一次分配的结果和连续满足减少条件的间隔数
+        size_t peak_demand;
+        budget_allocation allocation;
+        size_t shrink_count;
+    };
+    budget_config m_config;
+    ::std::vector<member> m_members;
+    ::std::thread m_thread;
+    bool m_stop = false;
+    mutable ::std::mutex m_lock;
+    ::std::condition_variable m_cv;
+
+    SYSCONAPI void add_member(const member& entry);
+    SYSCONAPI bool remove_member(const void* pool);
+    // 仲裁线程：采样并按间隔分配
+    void run();
+    // 采样各线程池需要的线程数，须在锁内调用
+    void sample_members();
+    // 按份额分配线程数并调整线程池，须在锁内调用
+    void allocate();
+
+public:
+    SYSCONAPI explicit worker_budget(const budget_config& config = budget_config());
+    SYSCONAPI ~worker_budget();
+    worker_budget(const worker_budget&) = delete;
+    worker_budget& operator=(const worker_budget&) = delete;
+    // 加入线程预算，已加入其他预算或者正在自动调整线程数时失败
+    template<bool handle_exception, class lock_type> bool attach(threadpool<handle_exception, lock_type>& pool, const budget_share& share = budget_share());
+    // 退出线程预算，线程池保持当前线程数
+    template<bool handle_exception, class lock_type> bool detach(threadpool<handle_exception, lock_type>& pool)
+    {
+        return remove_member(&pool);
+    }
+    // 设置、获取线程总数，0为逻辑CPU数
+    SYSCONAPI void set_total_threads(int total_threads);
+    SYSCONAPI int get_total_threads() const;
+    // 立即采样并分配一次
+    SYSCONAPI void rebalance();
+    // 获取上一次分配的结果
+    SYSCONAPI ::std::vector<budget_allocation> get_allocations() const;
+};
+
+/* 线程池类; handle_exception: 是否处理捕获任务异常
+*  lock_type: 任务队列锁类型（spin_mutex, ttas_mutex, ticket_mutex, mcs_mutex, adaptive_mutex）
+**/
+template<bool handle_exception, class lock_type> class threadpool
+{
+private:
+    // 线程是否已启动
+    bool m_is_start = false;
+    // 线程数
+    ::std::atomic<int> m_thread_number{ 0 };
+    ::std::atomic<int> m_thread_started{ 0 };
+    // 工作线程上下文
+    struct worker_context;
+    struct failure_node;
+    // 线程队列
+    ::std::list<::std::tuple<::std::thread, SAFE_HANDLE_OBJECT, SAFE_HANDLE_OBJECT, worker_context*>> m_thread_object;
+    // 已销毁分离的线程对象
+    ::std::list<::std::tuple<::std::thread, SAFE_HANDLE_OBJECT, SAFE_HANDLE_OBJECT, worker_context*>> m_thread_destroy;
+    // 任务队列
+    ::std::deque<task_object> m_tasks;
+    decltype(m_tasks) m_pause_tasks;
+    decltype(m_tasks)* m_push_tasks{ &m_tasks };
+    // 非工作线程记录的异常任务，各工作线程的异常任务记录在工作线程上下文中
+    ::std::atomic<failure_node*> m_failures{ nullptr };
+    // 异常任务的记录序号，取出时各记录栈按序号合并
+    ::std::atomic<size_t> m_failure_sequence{ 0 };
+    // 抛出异常的任务自动重试的最大次数、判断异常是否可以重试的函数和已重试的次数
+    ::std::atomic<size_t> m_max_retries{ 0 };
+    ::std::function<bool(const ::std::exception_ptr&)> m_retry_filter;
+    spin_mutex m_retry_lock;
+    ::std::atomic<size_t> m_task_retried{ 0 };
+    // 任务计数使用分片计数器，添加任务的线程和各工作线程修改不同的缓存行
+    sharded_counter m_task_exception;
+    sharded_counter m_task_completed;
+    sharded_counter m_task_all;
+    // 已开始运行的任务数，和已添加任务总数一起不加锁地估计任务队列数量
+    sharded_counter m_task_started;
+    // 取出时已取消、没有运行的任务数
+    sharded_counter m_task_cancelled;
+    // 任务队列容量（估计的未处理任务数），0为不限制; 超出容量时的处理策略、阻塞等待时间（毫秒，负数为一直等待）和丢弃回调
+    ::std::atomic<size_t> m_capacity{ 0 };
+    ::std::atomic<overflow_policy> m_overflow_policy{ overflow_policy::block };
+    ::std::atomic<long long> m_block_timeout{ -1 };
+    ::std::function<void(task_object&&)> m_drop_callback;
+    // 等待容量的添加任务的线程数，工作线程取出任务时有线程等待才通知
+    ::std::atomic<size_t> m_blocked_producers{ 0 };
+    ::std::mutex m_capacity_lock;
+    ::std::condition_variable m_capacity_cv;
+    // 任务队列最大长度（任务队列读写锁内更新）和各处理策略的任务数
+    ::std::atomic<size_t> m_high_water{ 0 };
+    ::std::atomic<size_t> m_overflow_blocked{ 0 };
+    ::std::atomic<size_t> m_overflow_rejected{ 0 };
+    ::std::atomic<size_t> m_overflow_caller_runs{ 0 };
+    ::std::atomic<size_t> m_overflow_dropped{ 0 };
+    // 任务队列读写锁
+    mutable lock_type m_task_lock;
+    // 线程创建、销毁事件锁
+    ::std::recursive_mutex m_thread_lock;
+    // 通知事件
+    SAFE_HANDLE_OBJECT m_stop_thread; // 退出事件，关闭所有线程
+    SAFE_HANDLE_OBJECT m_notify_task; // 通知线程有新任务
+    // 线程优先级
+    thread_priority m_priority = thread_priority::uninitialized;
+    // 线程亲和性和指定的CPU集合，线程数改变时重新分配
+    thread_affinity m_affinity = thread_affinity::uninitialized;
+    ::std::vector<unsigned> m_affinity_cpus;
+    // 任务调度模式
+    ::std::atomic<schedule_mode> m_schedule_mode{ schedule_mode::shared_queue };
+    // 自动调整线程数的控制线程、配置和调整记录
+    ::std::thread m_autoscale_thread;
+    autoscale_config m_autoscale_config;
+    ::std::deque<autoscale_decision> m_autoscale_decisions;
+    bool m_autoscale_stop = false;
+    mutable ::std::mutex m_autoscale_lock;
+    ::std::condition_variable m_autoscale_cv;
+    // 启动、停止自动调整和加入线程预算的锁
+    ::std::mutex m_autoscale_control_lock;
+    // 定时器线程和定时任务最小堆，第一个定时任务添加时启动定时器线程
+    ::std::thread m_timer_thread;
+    ::std::vector<timer_entry> m_timers;
+    // 定时任务堆达到此大小时清除已取消的定时任务，清除后设为剩余数量的2倍，均摊到每次添加为常数时间
+    size_t m_timers_purge_size = 64;
+    bool m_timer_stop = false;
+    mutable ::std::mutex m_timer_lock;
+    ::std::condition_variable m_timer_cv;
+    // 空闲线程等待策略，自旋和让出CPU阶段各自的时长
+    ::std::atomic<idle_policy> m_idle_policy{ idle_policy::park };
+    ::std::atomic<long long> m_idle_spin_ns{ 50000 };
+    // 新任务通知计数，自旋和让出CPU的线程据此发现新任务
+    ::std::atomic<size_t> m_notify_epoch{ 0 };
+    // 进入内核等待的线程数，没有线程等待时不设置通知事件
+    ::std::atomic<size_t> m_parked_threads{ 0 };
+    // 高、低优先级任务队列，普通优先级使用m_tasks; 暂停时不调度
+    decltype(m_tasks) m_high_tasks;
+    decltype(m_tasks) m_low_tasks;
+    // 高、低优先级任务队列中的任务数
+    ::std::atomic<size_t> m_priority_waiting{ 0 };
+    // 较低优先级的任务被连续跳过的次数达到此值时优先调度一次，0为严格按优先级调度
+    ::std::atomic<size_t> m_priority_aging{ 32 };
+    // 工作线程一次从任务队列取出的最大任务数，1为每次取一个
+    ::std::atomic<size_t> m_batch_size{ 16 };
+    // 已取出到工作线程批量任务队列、尚未运行的任务数
+    ::std::atomic<size_t> m_batch_tasks{ 0 };
+    // 各优先级任务计数，任务队列读写锁内访问
+    struct priority_counter
+    {
+        size_t total = 0;   // 已添加任务数
+        size_t aged = 0;    // 因老化提前调度的任务数
+        size_t skipped = 0; // 连续被更高优先级跳过的次数
+    };
+    priority_counter m_priority_counter[3];
+#ifdef THREADPOOL_HISTOGRAM
+    // 没有工作线程上下文的线程运行任务时使用的延迟统计
+    task_histogram m_histogram;
+    // 是否按任务类型统计延迟
+    ::std::atomic<bool> m_type_histogram{ false };
+    type_histogram_table m_type_histograms;
+#endif
+
+    // 工作线程上下文，线程池析构前不释放（线程分离到m_thread_destroy后保留）
+    // 异常任务记录节点，压入记录栈时不加锁，获取时整体取出
+    struct failure_node
+    {
+        task_failure failure;
+        size_t sequence;
+        failure_node* next;
+        failure_node(task_object&& task, ::std::exception_ptr exception, size_t attempts, size_t sequence_arg) :
+            failure(::std::move(task), ::std::move(exception), attempts), sequence(sequence_arg), next(nullptr){}
+    };
+    struct worker_context
+    {
+        threadpool* pool;
+        // 工作线程上下文序号
+        size_t index;
+        // 工作窃取模式下本线程的任务队列
+        work_stealing_deque<task_object*> local_tasks;
+        // 窃取起始位置
+        size_t steal_index;
+        // 内存优先分配的NUMA节点，-1为默认策略; 工作线程在运行下一个任务前应用
+        ::std::atomic<int> memory_node{ -1 };
+        int applied_memory_node = -1;
+        /* 从任务队列批量取出的任务，访问时加批量任务锁: 本线程取出任务时通常没有竞争，
+        *  clear、get_tasks、pause、detach在任务队列读写锁内加锁取出，加锁顺序为先任务队列读写锁后批量任务锁
+        **/
+        ::std::deque<task_object> batch_tasks;
+        spin_mutex batch_lock;
+        // 本线程记录的异常任务，只由本线程压入
+        ::std::atomic<failure_node*> failures{ nullptr };
+#ifdef THREADPOOL_HISTOGRAM
+        // 本线程运行任务的延迟统计，只由本线程记录
+        task_histogram histogram;
+#endif
+        worker_context(threadpool* pool_arg, size_t index_arg) : pool(pool_arg), index(index_arg), steal_index(index_arg){}
+        ~worker_context()
+        {
+            task_object* task;
+            while (local_tasks.pop(task))
+                delete task;
+            for (auto node = failures.load(); node;)
+            {
+                auto next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+    };
+    // 所有工作线程上下文，数量只增不减
+    ::std::unique_ptr<worker_context> m_workers[255];
+    ::std::atomic<size_t> m_worker_number{ 0 };
+    // 当前线程的工作线程上下文
+    SYSCONAPI static worker_context*& this_worker();
+    // 线程池的线程等待时运行一条任务，没有可运行的任务时返回false
+    SYSCONAPI static bool help_run(void* pool);
+    // 设置当前线程的帮助运行上下文，线程启动时调用
+    static void set_help_context(threadpool* object);
+    friend class worker_budget;
+    // 加入的线程预算，析构时退出
+    ::std::atomic<worker_budget*> m_budget{ nullptr };
+    // pool_future调度器共享的线程池句柄，析构时清空，之后的延续任务在当前线程直接运行
+    ::std::shared_ptr<scheduler_handle> m_scheduler_handle{ ::std::make_shared<scheduler_handle>(this, &post_task) };
+    // 线程预算的采样：估计的排队任务数和正在运行的任务数，只有正常运行时参与分配
+    static void budget_sample(void* pool, worker_budget::member_sample& result)
+    {
+        auto object = (threadpool*)pool;
+        size_t finished = object->m_task_completed.load() + object->m_task_exception.load() + object->m_task_cancelled.load();
+        size_t started = object->m_task_started.load();
+        size_t all = object->m_task_all.load();
+        result.thread_number = object->m_thread_started.load();
+        result.queue_depth = all > started ? all - started : 0;
+        result.running = started > finished ? started - finished : 0;
+        result.active = object->m_exit_event.load() == exit_event_t::NORMAL;
+    }
+    static bool budget_resize(void* pool, int thread_number)
+    {
+        return ((threadpool*)pool)->set_new_thread_number(thread_number);
+    }
+    static void budget_unbind(void* pool)
+    {
+        ((threadpool*)pool)->m_budget = nullptr;
+    }
+
+    enum class exit_event_t {
+        INITIALIZATION,
+        NORMAL,
+        PAUSE,
+        STOP_IMMEDIATELY,
+        WAIT_TASK_COMPLETE,
+    };
+    // 退出任务事件
+    ::std::atomic<exit_event_t> m_exit_event{ exit_event_t::INITIALIZATION };
+
+    // 线程入口函数
+    static size_t thread_entry(threadpool* object, HANDLE pause_event, HANDLE resume_event, worker_context* worker);
+    // 线程入口函数，线程启动时先执行一次启动函数
+    static size_t thread_entry_startup(threadpool* object, HANDLE pause_event, HANDLE resume_event, worker_context* worker, ::std::function<void()> startup_fn);
+    // 线程运行前准备
+    size_t pre_run(HANDLE pause_event, HANDLE resume_event);
+    /* 线程任务调度函数
+    *  返回值 >= success_code 表示正常退出，< success_code 为非正常退出
+    *  run函数体本身堆栈中没有对象，移动ebp/rbp寄存器安全，可以不处理异常
+    **/
+    size_t run(HANDLE pause_event, HANDLE resume_event);
+    // 按线程亲和性设置所有线程的CPU集合和内存节点，须在线程创建、销毁事件锁内调用
+    void apply_thread_affinity();
+    // 自动调整线程数的控制线程函数
+    void autoscale_run();
+    // 定时器线程函数：到期的定时任务添加到任务队列，周期任务按原定时间加周期重新排队
+    void timer_run();
+    // 添加定时任务，线程池析构中返回false
+    SYSCONAPI bool add_timer(timer_entry&& entry);
+    // 停止定时器线程并丢弃未到期的定时任务
+    void stop_timer();
+    // 绑定函数并添加定时任务
+    template<class Fn> ::std::pair<timer_handle, bool> push_timer(::std::chrono::steady_clock::time_point due, ::std::chrono::steady_clock::duration period, Fn&& fn)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(timer_handle(), false);
+        }
+        auto state = ::std::make_shared<timer_state>(task_object(::std::forward<Fn>(fn)), period.count() != 0);
+        timer_entry entry = { due, period, state };
+        if (!add_timer(::std::move(entry)))
+            return ::std::make_pair(timer_handle(), false);
+        return ::std::make_pair(timer_handle(state), true);
+    }
+
+    /* 新任务添加通知：只为已进入内核等待的线程设置通知事件，自旋和让出CPU的线程由通知计数发现新任务
+    *  通知计数和m_parked_threads都使用顺序一致的原子操作，工作线程登记等待后会再检查一次任务队列，不会丢失通知
+    **/
+    void notify()
+    { // 通知一个线程
+        m_notify_epoch.fetch_add(1);
+        if (m_parked_threads.load())
+            ::SetEvent(m_notify_task);
+    }
+    void notify(size_t attach_tasks_number)
+    { // 最多通知3个线程
+        m_notify_epoch.fetch_add(1);
+        auto&& i = auto_min(3UL, m_parked_threads.load(), attach_tasks_number);
+        while (i--)
+            ::SetEvent(m_notify_task);
+    }
+    // 任务延迟统计使用的当前时间（纳秒），未定义THREADPOOL_HISTOGRAM时为0
+    static long long histogram_clock()
+    {
+#ifdef THREADPOOL_HISTOGRAM
+        return ::std::chrono::duration_cast<::std::chrono::nanoseconds>(::std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        return 0;
+#endif
+    }
+    // 记录任务添加到任务队列的时间，取出后重新添加的任务保留原来的时间
+    static void stamp_task(task_object& task, long long now)
+    {
+#ifdef THREADPOOL_HISTOGRAM
+        if (!task.get_enqueue_time())
+            task.set_enqueue_time(now);
+#else
+        (void)task;
+        (void)now;
+#endif
+    }
+#ifdef THREADPOOL_HISTOGRAM
+    // 任务运行结束后记录排队延迟和运行时间，没有记录添加时间的任务（线程启动函数）不统计
+    void record_task(const task_object& task, long long start_time)
+    {
+        auto enqueue_time = task.get_enqueue_time();
+        if (!enqueue_time)
+            return;
+        auto end_time = histogram_clock();
+        auto worker = local_worker();
+        auto& histogram = worker ? worker->histogram : m_histogram;
+        histogram.queue_delay.record(start_time - enqueue_time);
+        histogram.execution.record(end_time - start_time);
+        if (m_type_histogram.load(::std::memory_order_relaxed))
+        {
+            auto type_histogram = m_type_histograms.find(task.target_type());
+            if (type_histogram)
+            {
+                type_histogram->queue_delay.record(start_time - enqueue_time);
+                type_histogram->execution.record(end_time - start_time);
+            }
+        }
+    }
+#endif
+    // 是否有当前可以调度的任务，工作线程进入内核等待前检查
+    bool has_ready_tasks() const
+    {
+        // 暂停或退出时不调度高、低优先级任务和本地任务队列
+        bool schedulable = m_exit_event.load() == exit_event_t::NORMAL || m_exit_event.load() == exit_event_t::WAIT_TASK_COMPLETE;
+        {
+            ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+            if (!m_tasks.empty() || (schedulable && (!m_high_tasks.empty() || !m_low_tasks.empty())))
+                return true;
+        }
+        return schedulable && local_worker() && get_local_tasks_number();
+    }
+    // 发现新任务后返回激活，暂停、退出事件优先
+    DWORD wake_ready(HANDLE* handles, DWORD count)
+    {
+        auto result = ::WaitForMultipleObjects(count, handles, FALSE, 0);
+        return result == WAIT_TIMEOUT ? WAIT_OBJECT_0 + 2 : result;
+    }
+    // 空闲线程等待通知事件：按空闲策略先自旋、让出CPU，期间有新任务通知时直接激活，最后进入内核等待
+    DWORD wait_notify(HANDLE* handles, DWORD count)
+    {
+        auto policy = m_idle_policy.load(::std::memory_order_relaxed);
+        if (policy != idle_policy::park)
+        {
+            auto epoch = m_notify_epoch.load();
+            auto spin_time = ::std::chrono::nanoseconds(m_idle_spin_ns.load(::std::memory_order_relaxed));
+            auto now = ::std::chrono::steady_clock::now();
+            auto spin_end = policy == idle_policy::spin ? now + spin_time : now;
+            auto yield_end = spin_end + spin_time;
+            for (size_t i = 1; now < yield_end; i++)
+            {
+                if (m_notify_epoch.load() != epoch)
+                    return wake_ready(handles, count);
+                if (now < spin_end)
+                {
+                    cpu_relax();
+                    if (i % 64) // 自旋时每64次检查一次时间
+                        continue;
+                }
+                else
+                    ::std::this_thread::yield();
+                now = ::std::chrono::steady_clock::now();
+            }
+        }
+        m_parked_threads.fetch_add(1);
+        if (has_ready_tasks())
+        {
+            m_parked_threads.fetch_sub(1);
+            return wake_ready(handles, count);
+        }
+        auto result = ::WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+        m_parked_threads.fetch_sub(1);
+        return result;
+    }
+
+    // 创建工作线程上下文，须在线程创建、销毁事件锁内调用，上下文用尽时返回nullptr（线程只使用任务队列）
+    worker_context* create_worker()
+    {
+        auto index = m_worker_number.load();
+        if (index >= sizeof(m_workers) / sizeof(m_workers[0]))
+            return nullptr;
+        m_workers[index].reset(new worker_context(this, index));
+        m_worker_number.store(index + 1, ::std::memory_order_release);
+        return m_workers[index].get();
+    }
+    // 当前线程是否为本线程池可以使用本地任务队列的工作线程
+    worker_context* local_worker() const
+    {
+        auto worker = this_worker();
+        return worker && worker->pool == this ? worker : nullptr;
+    }
+    // 所有工作线程本地任务队列中的任务数
+    size_t get_local_tasks_number() const
+    {
+        size_t result = 0;
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = 0; i < worker_number; i++)
+            result += m_workers[i]->local_tasks.size();
+        return result;
+    }
+    // 取出所有工作线程本地任务队列中的任务，添加到tasks末尾，返回取出的任务数
+    size_t drain_local_tasks(::std::deque<task_object>& tasks)
+    {
+        size_t result = 0;
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = 0; i < worker_number; i++)
+        {
+            auto& local_tasks = m_workers[i]->local_tasks;
+            task_object* task;
+            while (!local_tasks.empty())
+            {
+                if (local_tasks.steal(task))
+                {
+                    ::std::unique_ptr<task_object> task_ptr(task);
+                    tasks.push_back(::std::move(*task_ptr));
+                    result++;
+                }
+            }
+        }
+        return result;
+    }
+    // 取出所有工作线程的批量任务，按原有顺序添加到tasks前端（批量任务先于任务队列中的任务），须在任务队列读写锁内调用，返回取出的任务数
+    size_t drain_batch_tasks(::std::deque<task_object>& tasks)
+    {
+        size_t result = 0;
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = worker_number; i-- > 0;)
+        {
+            auto& worker = *m_workers[i];
+            ::std::lock_guard<spin_mutex> lck(worker.batch_lock);
+            result += worker.batch_tasks.size();
+            m_batch_tasks -= worker.batch_tasks.size();
+            while (!worker.batch_tasks.empty())
+            {
+                tasks.push_front(::std::move(worker.batch_tasks.back()));
+                worker.batch_tasks.pop_back();
+            }
+        }
+        return result;
+    }
+    // 从其他工作线程窃取任务，只有所有队列都为空时返回失败
+    bool steal_task(worker_context* worker, task_object*& task, size_t& task_num)
+    {
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        bool has_task = true;
+        while (has_task)
+        {
+            has_task = false;
+            for (size_t i = 0; i < worker_number; i++)
+            {
+                auto& victim = *m_workers[(worker->steal_index + i) % worker_number];
+                if (&victim == worker || victim.local_tasks.empty())
+                    continue;
+                if (victim.local_tasks.steal(task))
+                {
+                    worker->steal_index = (worker->steal_index + i) % worker_number;
+                    task_num = victim.local_tasks.size() + 1;
+                    return true;
+                }
+                has_task = true; // 竞争失败，重试
+            }
+        }
+        return false;
+    }
+
+    /* 按优先级选择任务类别，须在任务队列读写锁内调用，没有任务时返回false
+    *  较低优先级的任务连续被更高优先级跳过m_priority_aging次后调度一次（老化），避免饥饿
+    **/
+    bool select_priority(worker_context* worker, task_priority& priority, size_t& task_num)
+    {
+        // 暂停或退出时不调度高、低优先级任务
+        bool schedulable = m_exit_event.load() == exit_event_t::NORMAL || m_exit_event.load() == exit_event_t::WAIT_TASK_COMPLETE;
+        size_t local_num = worker ? worker->local_tasks.size() : 0;
+        bool has_tasks[] = { schedulable && !m_high_tasks.empty(), !m_tasks.empty() || local_num, schedulable && !m_low_tasks.empty() };
+        task_num = m_tasks.size() + local_num + (schedulable ? m_high_tasks.size() + m_low_tasks.size() : 0);
+        size_t selected = 3;
+        for (size_t i = 0; i < 3; i++)
+        {
+            if (!has_tasks[i])
+                m_priority_counter[i].skipped = 0;
+            else if (selected == 3)
+                selected = i;
+        }
+        if (selected == 3)
+            return false;
+        size_t aging = m_priority_aging.load(::std::memory_order_relaxed);
+        size_t promoted = 3;
+        for (size_t i = selected + 1; i < 3; i++)
+            if (has_tasks[i] && aging && ++m_priority_counter[i].skipped >= aging && promoted == 3)
+                promoted = i;
+        if (promoted != 3)
+        {
+            m_priority_counter[promoted].aged++;
+            selected = promoted;
+        }
+        m_priority_counter[selected].skipped = 0;
+        priority = (task_priority)selected;
+        return true;
+    }
+    // 批量任务放回任务队列前端，保持原有顺序; 暂停、退出时放回暂停任务队列
+    void return_batch_tasks(worker_context* worker)
+    {
+        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        ::std::lock_guard<spin_mutex> batch_lck(worker->batch_lock);
+        m_batch_tasks -= worker->batch_tasks.size();
+        while (!worker->batch_tasks.empty())
+        {
+            m_push_tasks->push_front(::std::move(worker->batch_tasks.back()));
+            worker->batch_tasks.pop_back();
+        }
+    }
+    /* 获取任务队列中的任务，返回当前任务和未执行任务总数（批量任务至少为2，运行完批量任务后再次获取）
+    *  还有其他任务时通知一个线程，批量取出任务时只通知一次
+    **/
+    ::std::pair<task_object, size_t> get_task()
+    {
+        task_object task;
+        auto worker = local_worker();
+        // 暂停或退出时不处理本地任务队列
+        bool use_local = worker && (m_exit_event.load() == exit_event_t::NORMAL || m_exit_event.load() == exit_event_t::WAIT_TASK_COMPLETE);
+        // 批量任务在任务边界检查：暂停、退出或有高、低优先级任务时放回任务队列; 可能已被clear等取出
+        if (worker)
+        {
+            ::std::unique_lock<spin_mutex> batch_lck(worker->batch_lock);
+            if (!worker->batch_tasks.empty())
+            {
+                if (use_local && !m_priority_waiting.load(::std::memory_order_acquire))
+                {
+                    ::std::swap(task, worker->batch_tasks.front());
+                    worker->batch_tasks.pop_front();
+                    m_batch_tasks--;
+                    return ::std::make_pair(::std::move(task), worker->batch_tasks.size() + 2);
+                }
+                batch_lck.unlock();
+                return_batch_tasks(worker);
+            }
+        }
+        task_object* local_task;
+        // 没有高、低优先级任务时直接使用本地任务队列
+        if (use_local && !m_priority_waiting.load(::std::memory_order_acquire) && worker->local_tasks.pop(local_task))
+        {
+            ::std::unique_ptr<task_object> task_ptr(local_task);
+            if (!worker->local_tasks.empty())
+                notify();
+            return ::std::make_pair(::std::move(*task_ptr), worker->local_tasks.size() + 1);
+        }
+        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        task_priority priority;
+        size_t task_num;
+        if (select_priority(use_local ? worker : nullptr, priority, task_num))
+        {
+            auto tasks = &m_tasks;
+            switch (priority)
+            {
+            case task_priority::high:
+                tasks = &m_high_tasks;
+                m_priority_waiting--;
+                break;
+            case task_priority::low:
+                tasks = &m_low_tasks;
+                m_priority_waiting--;
+                break;
+            case task_priority::normal:
+            default: // 普通优先级先使用本地任务队列
+                if (use_local && worker->local_tasks.pop(local_task))
+                {
+                    lck.unlock();
+                    ::std::unique_ptr<task_object> task_ptr(local_task);
+                    if (task_num > 1)
+                        notify();
+                    return ::std::make_pair(::std::move(*task_ptr), task_num);
+                }
+                break;
+            }
+            if (!tasks->empty()) // 本地任务可能已被窃取
+            {
+                ::std::swap(task, tasks->front());
+                tasks->pop_front();
+                // 批量取出普通优先级任务：每个线程平分任务队列，不超过批量大小
+                size_t batch = 1;
+                if (use_local && tasks == &m_tasks && !m_priority_waiting.load(::std::memory_order_relaxed))
+                {
+                    batch = auto_min(m_batch_size.load(::std::memory_order_relaxed), (tasks->size() + 1) / auto_max(1, get_thread_number()));
+                    if (batch > 1)
+                    {
+                        ::std::lock_guard<spin_mutex> batch_lck(worker->batch_lock);
+                        for (size_t i = 1; i < batch; i++)
+                        {
+                            worker->batch_tasks.push_back(::std::move(tasks->front()));
+                            tasks->pop_front();
+                        }
+                        m_batch_tasks += batch - 1;
+                    }
+                }
+                lck.unlock();
+                if (task_num > auto_max((size_t)1, batch))
+                    notify();
+                return ::std::make_pair(::std::move(task), batch > 1 ? batch + 1 : task_num);
+            }
+        }
+        lck.unlock();
+        if (use_local && steal_task(worker, local_task, task_num))
+        {
+            ::std::unique_ptr<task_object> task_ptr(local_task);
+            if (task_num > 1)
+                notify();
+            return ::std::make_pair(::std::move(*task_ptr), task_num);
+        }
+        return ::std::make_pair(::std::move(task), 0);
+    }
+    /* 记录抛出异常的任务：工作线程（包括等待时帮助运行）压入本线程的记录栈，其他线程压入线程池的记录栈，
+    *  取得记录序号后只用一次原子操作压入，不再重新抛出任务对象
+    **/
+    void push_exception_task(task_object&& task, ::std::exception_ptr exception, size_t attempts)
+    {
+        auto sequence = m_failure_sequence.fetch_add(1, ::std::memory_order_relaxed);
+        auto node = new failure_node(::std::move(task), ::std::move(exception), attempts, sequence);
+        auto worker = local_worker();
+        auto& failures = worker ? worker->failures : m_failures;
+        node->next = failures.load(::std::memory_order_relaxed);
+        while (!failures.compare_exchange_weak(node->next, node, ::std::memory_order_release, ::std::memory_order_relaxed));
+        m_task_exception++;
+    }
+    // 取出记录栈中的所有记录节点，添加到nodes末尾
+    static void drain_failures(::std::atomic<failure_node*>& log, ::std::vector<::std::unique_ptr<failure_node>>& nodes)
+    {
+        for (auto node = log.exchange(nullptr, ::std::memory_order_acquire); node;)
+        {
+            nodes.emplace_back(node);
+            node = node->next;
+        }
+    }
+    // 按重试策略判断抛出异常的任务是否再次运行：运行次数未超过重试次数、任务未取消且过滤函数允许
+    bool retry_task(const task_object& task, const ::std::exception_ptr& exception, size_t attempts)
+    {
+        if (attempts > m_max_retries.load(::std::memory_order_relaxed) || task.is_cancelled())
+            return false;
+        ::std::function<bool(const ::std::exception_ptr&)> filter;
+        {
+            ::std::lock_guard<spin_mutex> lck(m_retry_lock);
+            filter = m_retry_filter;
+        }
+        if (filter && !filter(exception))
+            return false;
+        m_task_retried++;
+        return true;
+    }
+    /* 获取等待时帮助运行的任务：先运行本线程的批量任务和本地任务，再从任务队列末尾取出最新添加的任务，
+    *  通常是等待的任务刚添加的子任务，避免帮助运行其他等待中的任务而嵌套过深; 没有时和get_task相同
+    **/
+    ::std::pair<task_object, size_t> get_help_task()
+    {
+        auto worker = local_worker();
+        bool has_local = false;
+        if (worker)
+        {
+            ::std::lock_guard<spin_mutex> batch_lck(worker->batch_lock);
+            has_local = !worker->batch_tasks.empty() || !worker->local_tasks.empty();
+        }
+        if (!has_local)
+        {
+            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+            if (!m_tasks.empty() && !m_priority_waiting.load(::std::memory_order_relaxed))
+            {
+                task_object task;
+                ::std::swap(task, m_tasks.back());
+                m_tasks.pop_back();
+                return ::std::make_pair(::std::move(task), m_tasks.size() + 1);
+            }
+        }
+        return get_task();
+    }
+    // 更新任务队列最大长度，须在任务队列读写锁内调用
+    void update_high_water()
+    {
+        auto size = m_push_tasks->size() + m_high_tasks.size() + m_low_tasks.size();
+        if (size > m_high_water.load(::std::memory_order_relaxed))
+            m_high_water.store(size, ::std::memory_order_relaxed);
+    }
+    // 任务取出后唤醒等待容量的线程
+    void notify_capacity()
+    {
+        if (m_blocked_producers.load())
+        {
+            ::std::lock_guard<::std::mutex> lck(m_capacity_lock);
+            m_capacity_cv.notify_all();
+        }
+    }
+    enum class admission
+    {
+        accept,         // 添加到任务队列
+        reject,         // 添加失败
+        caller_runs,    // 在添加任务的线程中运行
+    };
+    // 任务队列数量为depth时是否可以再添加count个任务，超过容量的批量任务在任务队列为空时可以添加
+    static bool has_capacity(size_t capacity, size_t count, size_t depth)
+    {
+        return depth + count <= capacity || !depth;
+    }
+    // 按估计的任务队列数量判断是否可以再添加count个任务，估计值不满足时再加锁按准确的数量判断
+    bool has_capacity(size_t capacity, size_t count) const
+    {
+        return has_capacity(capacity, count, get_tasks_number_estimate()) || has_capacity(capacity, count, get_tasks_number());
+    }
+    // 按容量和处理策略决定count个任务能否添加，不限制容量时只读取一次原子变量，估计值有容量时不加锁
+    admission admit_tasks(size_t count)
+    {
+        auto capacity = m_capacity.load(::std::memory_order_relaxed);
+        if (!capacity || has_capacity(capacity, count, get_tasks_number_estimate()))
+            return admission::accept;
+        return overflow_tasks(capacity, count);
+    }
+    // 超出容量时在添加任务的线程中运行任务，和工作线程相同地跳过已取消的任务
+    static void caller_run(task_object&& task)
+    {
+        if (!task.is_cancelled())
+            task();
+    }
+    // 超出容量时按处理策略阻塞、失败、在当前线程运行或者丢弃最早的任务
+    SYSCONAPI admission overflow_tasks(size_t capacity, size_t count);
+    // 丢弃最早的count个任务，在当前线程调用丢弃回调，返回丢弃的任务数
+    size_t drop_oldest_tasks(size_t count);
+    // 按容量添加一条任务
+    bool push_admitted(task_object&& task)
+    {
+        switch (admit_tasks(1))
+        {
+        case admission::reject:
+            return false;
+        case admission::caller_runs:
+            caller_run(::std::move(task));
+            return true;
+        case admission::accept:
+        default:
+            push_task(::std::move(task));
+            return true;
+        }
+    }
+    bool push_admitted(task_priority priority, task_object&& task)
+    {
+        switch (admit_tasks(1))
+        {
+        case admission::reject:
+            return false;
+        case admission::caller_runs:
+            caller_run(::std::move(task));
+            return true;
+        case admission::accept:
+        default:
+            push_task(priority, ::std::move(task));
+            return true;
+        }
+    }
+    // 添加一条任务：工作窃取模式下工作线程添加到本地任务队列，否则添加到任务队列
+    void push_task(task_object&& task)
+    {
+        stamp_task(task, histogram_clock());
+        auto worker = local_worker();
+        if (worker && m_schedule_mode.load(::std::memory_order_relaxed) == schedule_mode::work_stealing &&
+            m_exit_event.load() == exit_event_t::NORMAL)
+        {
+            worker->local_tasks.push(new task_object(::std::move(task)));
+        }
+        else
+        {
+            // 任务队列读写锁
+            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+            m_push_tasks->push_back(::std::move(task));
+            update_high_water();
+            lck.unlock();
+        }
+        m_task_all++;
+        notify();
+    }
+    // 添加count个相同的任务，只加锁一次，返回添加的任务数
+    template<class Fn> size_t push_copies(const Fn& fn, size_t count)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return 0;
+        }
+        if (!count)
+            return 0;
+        auto now = histogram_clock();
+        auto worker = local_worker();
+        if (worker && m_schedule_mode.load(::std::memory_order_relaxed) == schedule_mode::work_stealing &&
+            m_exit_event.load() == exit_event_t::NORMAL)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                auto task = new task_object(fn);
+                stamp_task(*task, now);
+                worker->local_tasks.push(task);
+            }
+        }
+        else
+        {
+            // 任务队列读写锁
+            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+            for (size_t i = 0; i < count; i++)
+            {
+                m_push_tasks->emplace_back(fn);
+                stamp_task(m_push_tasks->back(), now);
+            }
+            update_high_water();
+            lck.unlock();
+        }
+        m_task_all += count;
+        notify(count);
+        return count;
+    }
+    // 并行执行：调用线程和最多线程数个辅助任务各运行一次participant(state)，等待所有索引完成
+    template<class Participant> void parallel_run(size_t count, size_t grain, const Participant& participant)
+    {
+        size_t participants = (size_t)get_thread_number() + 1;
+        if (!grain) // 自动粒度：每个参与者平均约8个区间
+            grain = auto_max((size_t)1, count / (participants * 8));
+        auto state = ::std::make_shared<parallel_state>(count, grain, participants);
+        // 辅助任务数不超过区间数，暂停或退出时调用线程独自完成
+        size_t helpers = auto_min(participants - 1, (count - 1) / grain);
+        if (helpers && m_exit_event.load() == exit_event_t::NORMAL)
+            push_copies([state, participant]{ participant(*state); }, helpers);
+        participant(*state);
+        state->wait();
+        state->rethrow();
+    }
+    template<class Fn> static void invoke_address(void* fn)
+    {
+        (*(Fn*)fn)();
+    }
+    // 添加一条指定优先级的任务，普通优先级和push_task相同
+    void push_task(task_priority priority, task_object&& task)
+    {
+        if (priority != task_priority::high && priority != task_priority::low)
+            return push_task(::std::move(task));
+        stamp_task(task, histogram_clock());
+        // 任务队列读写锁
+        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+        (priority == task_priority::high ? m_high_tasks : m_low_tasks).push_back(::std::move(task));
+        m_priority_counter[(size_t)priority].total++;
+        m_priority_waiting++;
+        update_high_water();
+        lck.unlock();
+        m_task_all++;
+        notify();
+    }
+    /* 取出高、低优先级任务，高优先级任务添加到tasks前面，低优先级任务添加到末尾，须在任务队列读写锁内调用
+    *  取出的任务从各优先级已添加任务数中减去，调用者同时从添加的任务总数中减去，返回取出的任务数
+    **/
+    size_t take_priority_tasks(decltype(m_tasks)& tasks)
+    {
+        size_t result = m_high_tasks.size() + m_low_tasks.size();
+        m_priority_counter[(size_t)task_priority::high].total -= m_high_tasks.size();
+        m_priority_counter[(size_t)task_priority::low].total -= m_low_tasks.size();
+        while (!m_high_tasks.empty())
+        {
+            tasks.push_front(::std::move(m_high_tasks.back()));
+            m_high_tasks.pop_back();
+        }
+        while (!m_low_tasks.empty())
+        {
+            tasks.push_back(::std::move(m_low_tasks.front()));
+            m_low_tasks.pop_front();
+        }
+        m_priority_waiting = 0;
+        return result;
+    }
+    // 添加延续任务，退出流程中返回false，由调度器在当前线程直接运行
+    static bool post_task(void* pool, task_object& task)
+    {
+        auto object = (threadpool*)pool;
+        switch (object->m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            object->push_task(::std::move(task));
+            return true;
+        default:
+            return false;
+        }
+    }
+    // 本线程池的任务调度器
+    pool_scheduler scheduler()
+    {
+        pool_scheduler result;
+        result.handle = m_scheduler_handle;
+        return result;
+    }
+    template<class T> friend class pool_future;
+    // 生成count个批量任务，加锁一次添加到任务队列; 生成函数抛出异常时未生成的任务设置为broken_promise
+    template<class T, class Fn, class Make> ::std::pair<bulk_future<T>, bool> push_bulk_tasks(size_t count, Make&& make)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(bulk_future<T>(), false);
+        }
+        auto state = ::std::allocate_shared<bulk_state<T>>(arena_allocator<bulk_state<T>>(), count);
+        state->retain(state);
+        decltype(m_tasks) tasks;
+        size_t index = 0;
+        try
+        {
+            for (; index < count; index++)
+                tasks.emplace_back(bulk_task<T, Fn>(state.get(), index, make(index)));
+        }
+        catch (...)
+        {
+            state->abandon_from(index);
+            throw;
+        }
+        // 退出流程中添加失败，任务销毁时设置为broken_promise
+        bool result = !count || push_tasks(::std::move(tasks)) == count;
+        return ::std::make_pair(bulk_future<T>(::std::move(state)), result);
+    }
+    // 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]
+    bool run_task(::std::pair<task_object, size_t>&& task_val);
+
+    // 设置新的处理线程数，退出流程和未初始化的线程池则失败，线程启动时先执行一次启动函数
+    SYSCONAPI bool _set_new_thread_number(int thread_number_new, ::std::function<void()>&& startup_fn);
+
+public:
+    // 标准线程结束代码
+    static const size_t success_code = 0x00001000;
+
+    threadpool(){}
+    threadpool(int thread_number){ set_thread_number(thread_number); }
+    // 线程启动时先执行一次启动函数
+    template<class Fn, class... Args> threadpool(int thread_number, Fn&& startup_fn, Args&&... args)
+    {
+        set_thread_number(thread_number, ::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...);
+    }
+    SYSCONAPI ~threadpool();
+    // 复制构造函数
+    threadpool(const threadpool&) = delete;
+    // 复制赋值语句
+    threadpool& operator=(const threadpool&) = delete;
+    // 移动构造函数
+    threadpool(threadpool&&) = delete;
+    // 移动赋值语句
+    threadpool& operator=(threadpool&&) = delete;
+
+    // 启动暂停pause的线程
+    bool start()
+    {
+        // 任务队列读写锁
+        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::PAUSE:
+            m_exit_event = exit_event_t::NORMAL;
+            ::std::swap(m_tasks, m_pause_tasks);
+            m_push_tasks = &m_tasks;
+            {
+                // 暂停时可能有工作线程刚添加到本地任务队列的任务，暂停时添加的高、低优先级任务也需要调度
+                auto task_number = m_tasks.size() + get_local_tasks_number() + m_priority_waiting.load();
+                assert(m_pause_tasks.size() == 0);
+                lck.unlock();
+                notify(task_number);
+            }
+        case exit_event_t::NORMAL:
+            return true;
+            // 退出流程中禁止操作线程控制事件
+        case exit_event_t::INITIALIZATION:
+        default:
+            return false;
+        }
+    }
+    // 暂停线程执行，直到退出stop或者启动start
+    bool pause()
+    {
+        // 任务队列读写锁
+        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+            m_exit_event = exit_event_t::PAUSE;
+            ::std::swap(m_tasks, m_pause_tasks);
+            m_push_tasks = &m_pause_tasks;
+            drain_local_tasks(m_pause_tasks);
+            drain_batch_tasks(m_pause_tasks);
+            lck.unlock();
+            assert(m_tasks.size() == 0);
+        case exit_event_t::PAUSE:
+            return true;
+        case exit_event_t::INITIALIZATION:
+        default: // 退出流程中禁止操作线程控制事件
+            return false;
+        }
+    }
+    // 立即结束任务，未处理的任务将丢弃：在当前线程销毁，pool_future、任务图等设置为broken_promise
+    void stop()
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::WAIT_TASK_COMPLETE:
+            // 任务队列读写锁
+            m_task_lock.lock();
+            ::std::swap(m_tasks, m_pause_tasks);
+            m_push_tasks = &m_pause_tasks;
+            drain_local_tasks(m_pause_tasks);
+            drain_batch_tasks(m_pause_tasks);
+            take_priority_tasks(m_pause_tasks); // 随后由clear清理
+            m_task_lock.unlock();
+            assert(m_tasks.size() == 0);
+        case exit_event_t::PAUSE:
+            m_exit_event = exit_event_t::STOP_IMMEDIATELY;
+            ::SetEvent(m_stop_thread);
+            clear(); // 等待未处理任务的线程不会一直等待
+        case exit_event_t::INITIALIZATION:
+        default:
+            break;
+        }
+    }
+    // 当任务队列执行完毕后退出线程，如果线程池正在退出则失败
+    bool stop_on_completed()
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::PAUSE:
+            start();
+        case exit_event_t::NORMAL:
+            m_exit_event = exit_event_t::WAIT_TASK_COMPLETE;
+            ::SetEvent(m_stop_thread);
+        case exit_event_t::WAIT_TASK_COMPLETE:
+            return true;
+        case exit_event_t::INITIALIZATION:
+        default:
+            return false;
+        }
+    }
+
+    // 添加一个任务
+    template<class Fn, class... Args> bool push(Fn&& fn, Args&&... args)
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return false;
+        }
+        // 绑定函数，生成任务（仿函数）
+        return push_admitted(task_object(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)));
+    }
+    // 添加一个任务并返回返回值对象pair<future,bool>，使用future::get获取返回值（若未完成会等待完成）
+    template<class Fn, class... Args> auto push_future(Fn&& fn, Args&&... args)
+        -> ::std::pair<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        ::std::future<result_type> future_obj;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(::std::move(future_obj), false);
+        }
+        // 绑定函数，共享状态从task_arena分配
+        typedef decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)) bind_type;
+        future_task<result_type, bind_type> task_obj(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+        future_obj = task_obj.get_future();
+        // 生成任务（仿函数），添加失败时任务销毁，future设置为broken_promise
+        bool result = push_admitted(task_object(::std::move(task_obj)));
+        return ::std::make_pair(::std::move(future_obj), result);
+    }
+    /* 添加一个可以取消的任务：工作线程取出任务时如果令牌已取消，不运行任务，计入取消任务数
+    *  正在运行的任务可以通过自己保存的令牌检查是否已取消; 如果线程池已进入退出流程，返回false
+    **/
+    template<class Fn, class... Args> bool push_cancellable(const cancellation_token& token, Fn&& fn, Args&&... args)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return false;
+        }
+        return push_admitted(task_object(make_cancellable_task(token, ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))));
+    }
+    // 添加一个可以取消的任务并返回返回值对象pair<future,bool>，取消而没有运行的任务，future设置为broken_promise异常
+    template<class Fn, class... Args> auto push_future_cancellable(const cancellation_token& token, Fn&& fn, Args&&... args)
+        -> ::std::pair<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        ::std::future<result_type> future_obj;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(::std::move(future_obj), false);
+        }
+        typedef decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)) bind_type;
+        future_task<result_type, bind_type> task_obj(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+        future_obj = task_obj.get_future();
+        bool result = push_admitted(task_object(make_cancellable_task(token, ::std::move(task_obj))));
+        return ::std::make_pair(::std::move(future_obj), result);
+    }
+    // 添加一个任务并返回返回值对象pair<pool_future,bool>，可以使用pool_future::then添加延续任务
+    template<class Fn, class... Args> auto push_pool_future(Fn&& fn, Args&&... args)
+        -> ::std::pair<pool_future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        typedef decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)) bind_type;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(pool_future<result_type>(), false);
+        }
+        auto state = ::std::allocate_shared<pool_future_state<result_type>>(arena_allocator<pool_future_state<result_type>>(), scheduler());
+        pool_future<result_type> future_obj(state);
+        // 绑定函数，生成任务（仿函数）
+        bool result = push_admitted(task_object(pool_future_task<result_type, bind_type>(::std::move(state), ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))));
+        return ::std::make_pair(::std::move(future_obj), result);
+    }
+#ifdef THREADPOOL_COROUTINE
+    // co_await schedule()的等待对象：通过任务队列在工作线程中恢复协程
+    class schedule_awaiter
+    {
+    private:
+        threadpool* m_pool;
+        // 恢复任务未运行就被销毁或者线程池已退出
+        bool m_cancelled = false;
+
+    public:
+        explicit schedule_awaiter(threadpool* pool) : m_pool(pool){}
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+        bool await_suspend(::std::coroutine_handle<> handle)
+        {
+            coroutine_resume_task task(handle, &m_cancelled);
+            /* 添加成功时任务可能已经在工作线程中恢复了协程; 添加失败但任务已移动到任务对象时，
+            *  被拒绝的任务对象销毁时已取消并恢复了协程; 两种情况都不能再访问等待对象
+            **/
+            if (m_pool->push(::std::move(task)) || task.released())
+                return true;
+            task.release();
+            m_cancelled = true;
+            return false;
+        }
+        // 协程被取消时抛出std::future_errc::broken_promise异常
+        void await_resume() const
+        {
+            if (m_cancelled)
+                ::std::rethrow_exception(broken_promise_exception());
+        }
+    };
+    // co_await pool.schedule()：挂起协程，通过和push相同的任务队列在工作线程中恢复，受pause、stop影响
+    schedule_awaiter schedule()
+    {
+        return schedule_awaiter(this);
+    }
+    // 在工作线程中启动协程任务并返回结果的pair<pool_future,bool>，协程挂起时不占用工作线程
+    template<class T> ::std::pair<pool_future<T>, bool> push_coroutine(coroutine_task<T> task)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return ::std::make_pair(pool_future<T>(), false);
+        }
+        auto state = ::std::make_shared<pool_future_state<T>>(scheduler());
+        pool_future<T> future_obj(state);
+        coroutine_start(this, ::std::move(task), ::std::move(state));
+        return ::std::make_pair(::std::move(future_obj), true);
+    }
+#endif // #ifdef THREADPOOL_COROUTINE
+    // 添加一个指定优先级的任务，高优先级任务先于普通和低优先级任务调度
+    template<class Fn, class... Args> bool push_priority(task_priority priority, Fn&& fn, Args&&... args)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return false;
+        }
+        // 绑定函数，生成任务（仿函数）
+        return push_admitted(priority, task_object(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)));
+    }
+    // 添加一个延迟运行的任务，到期后添加到任务队列，返回pair<timer_handle, bool>
+    template<class Rep, class Period, class Fn, class... Args> ::std::pair<timer_handle, bool> push_after(const ::std::chrono::duration<Rep, Period>& delay, Fn&& fn, Args&&... args)
+    {
+        return push_timer(::std::chrono::steady_clock::now() + ::std::chrono::duration_cast<::std::chrono::steady_clock::duration>(delay),
+            ::std::chrono::steady_clock::duration::zero(), ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+    }
+    // 添加一个在指定时间运行的任务，其他时钟的时间点按添加时的差值换算为steady_clock
+    template<class Clock, class Duration, class Fn, class... Args> ::std::pair<timer_handle, bool> push_at(const ::std::chrono::time_point<Clock, Duration>& time, Fn&& fn, Args&&... args)
+    {
+        return push_after(time - Clock::now(), ::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+    }
+    /* 添加一个周期运行的任务，第一次在一个周期后运行，直到取消或者线程池退出
+    *  按原定时间加周期计算下一次运行时间，不累积误差; 上一次尚未运行结束或错过多个周期时跳过，不会重叠运行
+    **/
+    template<class Rep, class Period, class Fn, class... Args> ::std::pair<timer_handle, bool> push_every(const ::std::chrono::duration<Rep, Period>& period, Fn&& fn, Args&&... args)
+    {
+        auto interval = ::std::chrono::duration_cast<::std::chrono::steady_clock::duration>(period);
+        if (interval <= ::std::chrono::steady_clock::duration::zero())
+            return ::std::make_pair(timer_handle(), false);
+        return push_timer(::std::chrono::steady_clock::now() + interval, interval, ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+    }
+    // 添加多个任务
+    template<class Fn, class... Args> bool push_multi(size_t count, Fn&& fn, Args&&... args)
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        assert(count >= 0 && count < USHRT_MAX);
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return false;
+        }
+        if (count)
+        {
+            // 绑定函数
+            auto task_obj = ::std::make_shared<decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))>(
+                ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+            // 生成任务（仿函数），所有任务共享同一个绑定的函数
+            auto bind_function = ::std::bind(function_wapper(), ::std::move(task_obj));
+            switch (admit_tasks(count))
+            {
+            case admission::reject:
+                return false;
+            case admission::caller_runs:
+                for (size_t i = 0; i < count; i++)
+                    bind_function();
+                return true;
+            case admission::accept:
+            default:
+                break;
+            }
+            auto now = histogram_clock();
+            // 任务队列读写锁
+            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+            for (size_t i = 0; i < count; i++)
+            {
+                m_push_tasks->emplace_back(bind_function);
+                stamp_task(m_push_tasks->back(), now);
+            }
+            update_high_water();
+            lck.unlock();
+            m_task_all += count;
+            notify(count);
+        }
+        return true;
+    }
+    // 添加多个任务并返回返回值对象pair<vector<future>,bool>，使用future::get获取返回值（若未完成会等待完成）
+    template<class Fn, class... Args> auto push_multi_future(size_t count, Fn&& fn, Args&&... args)
+        -> ::std::pair<::std::vector<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        assert(count >= 0 && count < USHRT_MAX);
+        ::std::vector<::std::future<result_type>> future_obj;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
             return ::std::make_pair(::std::move(future_obj), false);
         }
+        if (count)
+        {
+            future_obj.reserve(count);
+            decltype(m_tasks) tasks;
+            typedef decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...)) bind_type;
+            for (size_t i = 0; i < count; i++)
+            {
+                // 绑定函数，共享状态从task_arena分配
+                future_task<result_type, bind_type> task_obj(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
+                future_obj.push_back(task_obj.get_future());
+                // 生成任务（仿函数）
+                tasks.emplace_back(::std::move(task_obj));
+            }
+            // 只加锁一次，添加失败时任务销毁，future设置为broken_promise
+            if (push_tasks(::std::move(tasks)) != count)
+                return ::std::make_pair(::std::move(future_obj), false);
+        }
+        return ::std::make_pair(::std::move(future_obj), true);
+    }
+    /* 批量添加[first, last)中的函数对象，只加锁一次，返回所有任务共享一个状态的bulk_future
+    *  函数对象按顺序复制（move_iterator为移动）到任务中，第i个任务的结果为bulk_future::get(i)
+    **/
+    template<class Iterator> auto push_bulk(Iterator first, Iterator last)
+        -> ::std::pair<bulk_future<decltype(decay_type(*first)())>, bool>
+    {
+        typedef decltype(decay_type(*first)()) result_type;
+        typedef typename ::std::decay<decltype(*first)>::type function_type;
+        return push_bulk_tasks<result_type, function_type>((size_t)::std::distance(first, last), [&](size_t){ return *first++; });
+    }
+    /* 批量添加count个任务，第i个任务为generator(i)返回的函数对象，只加锁一次
+    *  generator在调用线程中按序号顺序调用，返回所有任务共享一个状态的bulk_future
+    **/
+    template<class Generator> auto push_bulk(size_t count, Generator&& generator)
+        -> ::std::pair<bulk_future<decltype(generator((size_t)0)())>, bool>
+    {
+        typedef decltype(generator((size_t)0)()) result_type;
+        typedef typename ::std::decay<decltype(generator((size_t)0))>::type function_type;
+        return push_bulk_tasks<result_type, function_type>(count, generator);
+    }
+    // 添加一个任务集合，复制为任务对象后添加
+    size_t push_tasks(const ::std::deque<::std::function<void()>>& tasks)
+    {
+        decltype(m_tasks) task_objects;
+        for (auto& task : tasks)
+            task_objects.emplace_back(task);
+        return push_tasks(::std::move(task_objects));
+    }
+    // 添加一个任务集合，只加锁一次，任务队列为空时直接交换
+    size_t push_tasks(decltype(m_tasks)&& tasks)
+    {
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
+            break;
+        default: // 退出流程中禁止操作线程控制事件
+            return 0;
+        }
+        auto&& count = tasks.size();
+        if (count)
+        {
+            switch (admit_tasks(count))
+            {
+            case admission::reject:
+                return 0;
+            case admission::caller_runs:
+                for (auto& task : tasks)
+                    caller_run(::std::move(task));
+                tasks.clear();
+                return count;
+            case admission::accept:
+            default:
+                break;
+            }
+#ifdef THREADPOOL_HISTOGRAM
+            auto now = histogram_clock();
+            for (auto& task : tasks)
+                stamp_task(task, now);
+#endif
+            // 任务队列读写锁
+            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+            if (m_push_tasks->empty())
+                m_push_tasks->swap(tasks);
+            while (!tasks.empty())
+            {
+                m_push_tasks->push_back(::std::move(tasks.front()));
+                tasks.pop_front();
+            }
+            update_high_water();
+            lck.unlock();
+            m_task_all += count;
+            notify(count);
+        }
+        return count;
+    }
+
+    // 添加一个任务集合，移动为任务对象后添加
+    size_t push_tasks(::std::deque<::std::function<void()>>&& tasks)
+    {
+        decltype(m_tasks) task_objects;
+        for (auto& task : tasks)
+            task_objects.emplace_back(::std::move(task));
+        tasks.clear();
+        return push_tasks(::std::move(task_objects));
+    }
+
+    /* 并行循环：对[first, last)中的每个索引调用fn(index)，返回时所有索引已完成
+    *  grain: 每次领取的最少索引数，0为自动; 调用线程参与执行，不会因线程池暂停或线程不足而阻塞
+    *  任务抛出异常时跳过尚未执行的区间，完成后在调用线程重新抛出第一个异常
+    **/
+    template<class Index, class Fn> void parallel_for(Index first, Index last, size_t grain, Fn&& fn)
+    {
+        static_assert(::std::is_integral<Index>::value, "parallel_for index must be integral");
+        if (!(first < last))
+            return;
+        auto participant = [first, &fn](parallel_state& state)
+        {
+            size_t begin, end, done = 0;
+            while (state.claim(begin, end))
+            {
+                if (!state.failed())
+                {
+                    try
+                    {
+                        for (auto i = begin; i < end; i++)
+                            fn((Index)(first + i));
+                    }
+                    catch (...)
+                    {
+                        state.set_exception(::std::current_exception());
+                    }
+                }
+                done += end - begin;
+            }
+            state.complete(done);
+        };
+        parallel_run((size_t)(last - first), grain, participant);
+    }
+    template<class Index, class Fn> void parallel_for(Index first, Index last, Fn&& fn)
+    {
+        parallel_for(first, last, 0, ::std::forward<Fn>(fn));
+    }
+    /* 并行归约：返回identity和所有fn(index)经reduce合并的结果，reduce须满足结合律和交换律
+    *  每个参与者先合并自己领取的区间得到部分结果，退出前再合并到总结果
+    **/
+    template<class Index, class T, class Fn, class Reduce> T parallel_reduce(Index first, Index last, size_t grain, T identity, Fn&& fn, Reduce&& reduce)
+    {
+        static_assert(::std::is_integral<Index>::value, "parallel_reduce index must be integral");
+        if (!(first < last))
+            return identity;
+        T result = identity;
+        spin_mutex result_lock;
+        // 没有领取到区间的参与者不访问调用线程的对象，调用线程可能已经返回
+        auto participant = [first, &identity, &result, &result_lock, &fn, &reduce](parallel_state& state)
+        {
+            size_t begin, end, done = 0;
+            if (!state.claim(begin, end))
+                return;
+            T partial = identity;
+            do
+            {
+                if (!state.failed())
+                {
+                    try
+                    {
+                        for (auto i = begin; i < end; i++)
+                            partial = reduce(::std::move(partial), fn((Index)(first + i)));
+                    }
+                    catch (...)
+                    {
+                        state.set_exception(::std::current_exception());
+                    }
+                }
+                done += end - begin;
+            } while (state.claim(begin, end));
+            if (!state.failed())
+            {
+                try
+                {
+                    ::std::lock_guard<spin_mutex> lck(result_lock);
+                    result = reduce(::std::move(result), ::std::move(partial));
+                }
+                catch (...)
+                {
+                    state.set_exception(::std::current_exception());
+                }
+            }
+            state.complete(done);
+        };
+        parallel_run((size_t)(last - first), grain, participant);
+        return result;
+    }
+    template<class Index, class T, class Fn, class Reduce> T parallel_reduce(Index first, Index last, T identity, Fn&& fn, Reduce&& reduce)
+    {
+        return parallel_reduce(first, last, 0, ::std::move(identity), ::std::forward<Fn>(fn), ::std::forward<Reduce>(reduce));
+    }
+    // 并行调用所有函数，返回时所有函数已完成，有异常时重新抛出第一个异常
+    void parallel_invoke(){}
+    template<class... Fns> void parallel_invoke(Fns&&... fns)
+    {
+        ::std::pair<void(*)(void*), void*> calls[] = { ::std::make_pair(&invoke_address<typename ::std::remove_reference<Fns>::type>,
+            const_cast<void*>(static_cast<const void*>(::std::addressof(fns))))... };
+        parallel_for((size_t)0, sizeof...(Fns), 1, [&calls](size_t i){ calls[i].first(calls[i].second); });
+    }
+
+    // 清理任务队列
+    void clear()
+    {
+        // 任务在锁外销毁，pool_future的延续任务可能添加新任务
+        decltype(m_tasks) tasks, pause_tasks;
+        {
+            ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock);
+            drain_local_tasks(*m_push_tasks);
+            drain_batch_tasks(*m_push_tasks); // 已取出到工作线程、尚未运行的批量任务一并清理
+            take_priority_tasks(*m_push_tasks);
+            // 清理的任务从添加的任务总数中减去
+            m_task_all -= m_tasks.size();
+            m_task_all -= m_pause_tasks.size();
+            m_tasks.swap(tasks);
+            m_pause_tasks.swap(pause_tasks);
+        }
+        notify_capacity();
+    }
+    // 获取任务队列中的所有任务
+    decltype(m_tasks) get_tasks()
+    {
+        decltype(m_tasks) tasks;
+        {
+            ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+            drain_local_tasks(*m_push_tasks);
+            drain_batch_tasks(*m_push_tasks);
+            take_priority_tasks(*m_push_tasks); // 按优先级顺序排列
+            m_task_all -= m_push_tasks->size();
+            m_push_tasks->swap(tasks);
+        }
+        notify_capacity();
+        return ::std::move(tasks);
+    }
+
+    // 分离所有任务，分离的线程池对象线程数不变
+    void detach()
+    {
+        detach(m_thread_started);
+    }
+    // 分离所有任务，设置分离的线程池对象线程数为thread_number_new
+    SYSCONAPI void detach(int thread_number_new);
+    // 分离任务，并得到分离任务执行情况的future
+    ::std::future<size_t> detach_future()
+    {
+        return detach_future(m_thread_started);
+    }
+    // 分离任务，设置分离的线程池对象线程数为thread_number_new，并得到分离任务执行情况的future
+    SYSCONAPI ::std::future<size_t> detach_future(int thread_number_new);
+    /* 分离任务到所有线程池共用的后台线程池，不创建线程池对象和线程（后台线程池第一次使用时除外），
+    *  并得到分离任务全部完成（运行或者被清理）的future
+    **/
+    ::std::future<size_t> detach_shared()
+    {
+        return detach_shared(nullptr);
+    }
+    /* 分离任务到后台线程池，threadpool<true>分离的任务抛出异常时记录到failures（只包含本次分离的任务），
+    *  future就绪后读取; failures为空时丢弃异常记录，后台线程池不保留异常记录
+    **/
+    SYSCONAPI ::std::future<size_t> detach_shared(::std::shared_ptr<::std::deque<task_failure>> failures);
+    // 销毁线程池。WARNING: 线程会被直接分离，可能会造成资源泄露!!!
+    SYSCONAPI void destroy();
+
+    // 获取线程数量
+    int get_thread_number() const
+    {
+        return m_thread_started.load();
+    }
+    // 获取空闲线程数
+    int get_free_thread_number() const
+    {
+        if (get_tasks_number_estimate())
+            return 0;
+        else
+        {
+            size_t run_tasks = get_tasks_total_number() - get_tasks_completed_number() - get_tasks_cancelled_number();
+            int thread_num = get_thread_number();
+            return (int)run_tasks >= thread_num ? 0 : thread_num - (int)run_tasks;
+        }
+    }
+    // 获取任务队列数量
+    size_t get_tasks_number() const
+    {
+        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        return m_push_tasks->size() + get_local_tasks_number() + m_high_tasks.size() + m_low_tasks.size() + m_batch_tasks.load();
+    }
+    /* 不加锁地估计任务队列数量：已添加任务总数减去已开始运行的任务数
+    *  和get_tasks_number相同包括所有优先级、本地任务队列和批量取出的任务，添加、运行任务的同时读取时可能有少量偏差
+    **/
+    size_t get_tasks_number_estimate() const
+    {
+        auto started = m_task_started.load();
+        auto all = m_task_all.load();
+        return all - started < (SIZE_MAX >> 1) ? all - started : 0; // 清理任务的同时读取时可能为负数
+    }
+    // 获取指定优先级的任务队列数量
+    size_t get_tasks_number(task_priority priority) const
+    {
+        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        switch (priority)
+        {
+        case task_priority::high:
+            return m_high_tasks.size();
+        case task_priority::low:
+            return m_low_tasks.size();
+        case task_priority::normal:
+        default:
+            return m_push_tasks->size() + get_local_tasks_number() + m_batch_tasks.load();
+        }
+    }
+    // 获取异常任务数
+    size_t get_tasks_exception_number() const
+    {
+        return m_task_exception.load();
+    }
+    // 获取已完成任务数
+    size_t get_tasks_completed_number() const
+    {
+        return m_task_completed.load();
+    }
+    // 获取取出时已取消、没有运行的任务数
+    size_t get_tasks_cancelled_number() const
+    {
+        return m_task_cancelled.load();
+    }
+    // 获取已添加任务总数
+    size_t get_tasks_total_number() const
+    {
+        return m_task_all.load();
+    }
+    // 获取指定优先级已添加任务总数，普通优先级包括push等接口添加的任务
+    size_t get_tasks_total_number(task_priority priority) const
+    {
+        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        switch (priority)
+        {
+        case task_priority::high:
+        case task_priority::low:
+            return m_priority_counter[(size_t)priority].total;
+        case task_priority::normal:
+        default:
+            return m_task_all.load() - m_priority_counter[(size_t)task_priority::high].total - m_priority_counter[(size_t)task_priority::low].total;
+        }
+    }
+    // 获取指定优先级因老化提前调度的任务数
+    size_t get_tasks_aged_number(task_priority priority) const
+    {
+        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        return m_priority_counter[(size_t)priority].aged;
+    }
+
+    // 获取并清空异常任务队列
+    decltype(m_tasks) get_exception_tasks()
+    {
+        decltype(m_tasks) exception_tasks;
+        for (auto& failure : get_task_failures())
+            exception_tasks.push_back(::std::move(failure.task));
+        return exception_tasks;
+    }
+    /* 获取并清空异常任务记录（任务、异常和运行次数），可以和工作线程记录异常同时调用
+    *  各记录栈的记录按记录序号（开始记录的顺序）合并
+    **/
+    ::std::deque<task_failure> get_task_failures()
+    {
+        ::std::vector<::std::unique_ptr<failure_node>> nodes;
+        drain_failures(m_failures, nodes);
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = 0; i < worker_number; i++)
+            drain_failures(m_workers[i]->failures, nodes);
+        ::std::sort(nodes.begin(), nodes.end(), [](const ::std::unique_ptr<failure_node>& left, const ::std::unique_ptr<failure_node>& right)
+        {
+            return left->sequence < right->sequence;
+        });
+        ::std::deque<task_failure> failures;
+        for (auto& node : nodes)
+            failures.push_back(::std::move(node->failure));
+        return failures;
+    }
+    /* 设置抛出异常的任务自动重试的最大次数（0为不重试）和判断异常是否可以重试的函数（空函数为都可以重试），
+    *  重试在运行任务的线程中立即进行，超过次数或者不能重试时记录为异常任务; 只对threadpool<true>有效
+    **/
+    void set_retry_policy(size_t max_retries, ::std::function<bool(const ::std::exception_ptr&)> filter = nullptr)
+    {
+        {
+            ::std::lock_guard<spin_mutex> lck(m_retry_lock);
+            m_retry_filter = ::std::move(filter);
+        }
+        m_max_retries = max_retries;
+    }
+    // 获取自动重试的最大次数
+    size_t get_max_retries() const
+    {
+        return m_max_retries.load();
+    }
+    // 获取已自动重试的次数
+    size_t get_tasks_retried_number() const
+    {
+        return m_task_retried.load();
+    }
+    // 获取初始化线程数
+    int get_default_thread_number() const
+    {
+        return m_thread_number.load();
+    }
+    // 获取类型信息
+    static const ::std::type_info& this_type()
+    {
+        return typeid(threadpool);
+    }
+
+    // 初始化线程池，设置处理线程数，已初始化则失败
+    SYSCONAPI bool set_thread_number(int thread_number);
+    // 初始化线程池，设置处理线程数，已初始化则失败，线程启动时先执行一次启动函数
+    template<class Fn, class... Args> bool set_thread_number(int thread_number, Fn&& startup_fn, Args&&... args)
+    {
+        assert(thread_number >= 0 && thread_number < 255); // Thread number must greater than or equal 0 and less than 255
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::INITIALIZATION: // 未初始化的线程池
+            m_exit_event = exit_event_t::NORMAL;
+            m_stop_thread = CreateEventW(nullptr, TRUE, FALSE, nullptr);  // 手动复位，无信号
+            m_notify_task = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
+            break;
+        default: // 已初始化的线程池将失败
+            return false;
+        }
+        if (thread_number < 0)
+            return false;
+        m_thread_number = thread_number;
+        return set_new_thread_number(thread_number, ::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...);
+    }
+    // 设置新的处理线程数，退出流程和未初始化的线程池则失败
+    SYSCONAPI bool set_new_thread_number(int thread_number_new);
+    // 设置新的处理线程数，退出流程和未初始化的线程池则失败，线程启动时先执行一次启动函数
+    template<class Fn, class... Args> bool set_new_thread_number(int thread_number_new, Fn&& startup_fn, Args&&... args)
+    {
         // 绑定函数
-        auto task_obj = ::std::make_shared<::std::packaged_task<result_type()>>(
-            ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
-        future_obj = task_obj->get_future();
+        auto task_obj = ::std::make_shared<decltype(::std::bind(::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...))>(
+            ::std::bind(::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...));
         // 生成任务（仿函数）
         ::std::function<void()> bind_function(::std::bind(function_wapper(), ::std::move(task_obj)));
-        // 任务队列读写锁
-        ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-        m_push_tasks->push_back(::std::move(bind_function));
+        return _set_new_thread_number(thread_number_new, ::std::move(bind_function));
+    }
+
+    // 重置线程池数量为初始数量
+    bool reset_thread_number()
+    {
+        return set_new_thread_number(get_default_thread_number());
+    }
+
+    // 设置线程优先级
+    SYSCONAPI void set_thread_priority(thread_priority priority = thread_priority::uninitialized);
+    /* 设置线程亲和性，cpus为逻辑CPU序号（空则使用进程可用的所有CPU）
+    *  线程数改变后重新分配，从已销毁分离的线程中恢复的线程同样生效
+    **/
+    SYSCONAPI void set_thread_affinity(thread_affinity affinity, const ::std::vector<unsigned>& cpus = ::std::vector<unsigned>());
+    // 获取线程亲和性
+    thread_affinity get_thread_affinity() const
+    {
+        return m_affinity;
+    }
+    /* 启动自动调整线程数：控制线程定期检查任务队列数量、估计的排队时间和线程利用率，在min_threads和max_threads之间增减线程
+    *  减少的线程暂停在已销毁分离的线程中，增加线程时优先恢复; 已启动时更新配置。配置无效或线程池未初始化、已退出时返回false
+    **/
+    SYSCONAPI bool start_autoscale(const autoscale_config& config = autoscale_config());
+    // 停止自动调整线程数，线程数保持不变
+    SYSCONAPI void stop_autoscale();
+    // 是否正在自动调整线程数
+    bool is_autoscaling() const
+    {
+        ::std::lock_guard<::std::mutex> lck(m_autoscale_lock);
+        return m_autoscale_thread.joinable() && !m_autoscale_stop;
+    }
+    // 获取最近的调整记录，按时间排序
+    ::std::vector<autoscale_decision> get_autoscale_decisions() const
+    {
+        ::std::lock_guard<::std::mutex> lck(m_autoscale_lock);
+        return ::std::vector<autoscale_decision>(m_autoscale_decisions.begin(), m_autoscale_decisions.end());
+    }
+    // 设置空闲线程等待策略，spin_time为自旋和让出CPU阶段各自的时长，可在任意时刻切换
+    void set_idle_policy(idle_policy policy, ::std::chrono::microseconds spin_time = ::std::chrono::microseconds(50))
+    {
+        m_idle_spin_ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(spin_time).count();
+        m_idle_policy = policy;
+    }
+    // 获取空闲线程等待策略
+    idle_policy get_idle_policy() const
+    {
+        return m_idle_policy.load();
+    }
+    // 设置任务调度模式，可在任意时刻切换，已在工作线程本地任务队列中的任务不受影响
+    void set_schedule_mode(schedule_mode mode)
+    {
+        m_schedule_mode = mode;
+    }
+    // 获取任务调度模式
+    schedule_mode get_schedule_mode() const
+    {
+        return m_schedule_mode.load();
+    }
+    // 设置优先级老化阈值：较低优先级的任务连续被跳过aging次后调度一次，0为严格按优先级调度
+    void set_priority_aging(size_t aging)
+    {
+        m_priority_aging = aging;
+    }
+    // 获取优先级老化阈值
+    size_t get_priority_aging() const
+    {
+        return m_priority_aging.load();
+    }
+    // 设置工作线程一次从任务队列取出的最大任务数，实际数量不超过任务队列平分到每个线程的任务数，0和1为每次取一个
+    void set_batch_size(size_t batch_size)
+    {
+        m_batch_size = auto_max((size_t)1, batch_size);
+    }
+    // 获取工作线程一次从任务队列取出的最大任务数
+    size_t get_batch_size() const
+    {
+        return m_batch_size.load();
+    }
+    // 设置任务队列容量和超出容量时的处理策略，0为不限制容量；工作线程添加任务时不会阻塞
+    void set_capacity(size_t capacity, overflow_policy policy = overflow_policy::block)
+    {
+        m_overflow_policy = policy;
+        m_capacity = capacity;
+        notify_capacity();
+    }
+    // 获取任务队列容量，0为不限制容量
+    size_t get_capacity() const
+    {
+        return m_capacity.load();
+    }
+    // 获取超出容量时的处理策略
+    overflow_policy get_overflow_policy() const
+    {
+        return m_overflow_policy.load();
+    }
+    // 设置block策略的最长等待时间，超时后添加失败，负数为一直等待
+    void set_block_timeout(::std::chrono::milliseconds timeout)
+    {
+        m_block_timeout = (long long)timeout.count();
+    }
+    // 设置drop_oldest策略丢弃任务时的回调函数，在添加任务的线程中调用，空函数则直接销毁任务
+    void set_drop_callback(::std::function<void(task_object&&)> callback)
+    {
+        ::std::lock_guard<::std::mutex> lck(m_capacity_lock);
+        m_drop_callback = ::std::move(callback);
+    }
+    // 获取任务队列容量统计
+    queue_statistics get_queue_statistics() const
+    {
+        queue_statistics result;
+        result.capacity = m_capacity.load();
+        result.high_water = m_high_water.load();
+        result.blocked = m_overflow_blocked.load();
+        result.rejected = m_overflow_rejected.load();
+        result.caller_runs = m_overflow_caller_runs.load();
+        result.dropped = m_overflow_dropped.load();
+        return result;
+    }
+    // 清空任务队列容量统计
+    void reset_queue_statistics()
+    {
+        m_high_water = 0;
+        m_overflow_blocked = 0;
+        m_overflow_rejected = 0;
+        m_overflow_caller_runs = 0;
+        m_overflow_dropped = 0;
+    }
+#ifdef THREADPOOL_HISTOGRAM
+    // 获取任务排队延迟和运行时间直方图快照，合并所有线程的记录
+    task_histogram_snapshot get_task_histogram() const
+    {
+        task_histogram_snapshot result;
+        m_histogram.snapshot(result);
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = 0; i < worker_number; i++)
+            m_workers[i]->histogram.snapshot(result);
+        return result;
+    }
+    // 获取按任务对象类型统计的直方图快照，类型名称为type_info::name
+    ::std::vector<::std::pair<::std::string, task_histogram_snapshot>> get_type_histograms() const
+    {
+        ::std::vector<::std::pair<::std::string, task_histogram_snapshot>> result;
+        m_type_histograms.snapshot(result);
+        return result;
+    }
+    // 清空所有延迟统计，和任务运行同时进行时可能保留少量记录
+    void reset_task_histogram()
+    {
+        m_histogram.reset();
+        size_t worker_number = m_worker_number.load(::std::memory_order_acquire);
+        for (size_t i = 0; i < worker_number; i++)
+            m_workers[i]->histogram.reset();
+        m_type_histograms.reset();
+    }
+    // 设置是否按任务对象类型统计延迟，默认关闭
+    void set_type_histogram(bool enable)
+    {
+        m_type_histogram = enable;
+    }
+    bool get_type_histogram() const
+    {
+        return m_type_histogram.load();
+    }
+#endif
+    // 获取未到期的定时任务数，不包括已取消的定时任务
+    size_t get_timers_number() const
+    {
+        ::std::lock_guard<::std::mutex> lck(m_timer_lock);
+        return (size_t)::std::count_if(m_timers.begin(), m_timers.end(), [](const timer_entry& entry){ return !entry.state->is_cancelled(); });
+    }
+    // 等待fut就绪，本线程池的线程等待期间运行任务队列中的其他任务，其他线程阻塞等待
+    template<class Future> void help_wait(const Future& fut) const
+    {
+        ::help_wait(fut, this);
+    }
+    // 等待fut就绪并获取结果，等待方式和help_wait相同
+    template<class Future> auto help_get(Future& fut) const -> decltype(fut.get())
+    {
+        ::help_wait(fut, this);
+        return fut.get();
+    }
+    // 检查运行的线程是否为线程池管理的线程
+    bool is_owner()
+    {
+        return is_owner(::std::this_thread::get_id());
+    }
+    // 检查指定的线程ID是否为线程池管理的线程
+    bool is_owner(const ::std::thread::id& thread_id)
+    {
+        // 线程创建、销毁事件锁
+        ::std::unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
+        if (::std::any_of(m_thread_object.cbegin(), m_thread_object.cend(), [&](decltype(*m_thread_object.cend()) th_obj){ return thread_id == ::std::get<0>(th_obj).get_id(); }))
+            return true;
+        if (::std::any_of(m_thread_destroy.cbegin(), m_thread_destroy.cend(), [&](decltype(*m_thread_destroy.cend()) th_obj){ return thread_id == ::std::get<0>(th_obj).get_id(); }))
+            return true;
+        return false;
+    }
+    bool is_start() const
+    {
+        return m_is_start;
+    }
+};
+
+// 加入线程预算，已加入其他预算或者正在自动调整线程数时失败
+template<bool handle_exception, class lock_type> bool worker_budget::attach(threadpool<handle_exception, lock_type>& pool, const budget_share& share)
+{
+    typedef threadpool<handle_exception, lock_type> pool_type;
+    if (share.weight <= 0 || share.min_threads < 0 || share.max_threads < 0 || (share.max_threads && share.max_threads < share.min_threads))
+        return false;
+    {
+        // 和start_autoscale互斥，检查自动调整和绑定预算之间不会启动自动调整
+        ::std::lock_guard<::std::mutex> control_lck(pool.m_autoscale_control_lock);
+        if (pool.is_autoscaling())
+            return false;
+        worker_budget* expected = nullptr;
+        if (!pool.m_budget.compare_exchange_strong(expected, this))
+            return false;
+    }
+    member entry;
+    entry.pool = &pool;
+    entry.share = share;
+    entry.sample = &pool_type::budget_sample;
+    entry.resize = &pool_type::budget_resize;
+    entry.unbind = &pool_type::budget_unbind;
+    entry.peak_demand = 0;
+    entry.allocation.pool = &pool;
+    entry.allocation.share = share;
+    entry.allocation.thread_number = pool.get_thread_number();
+    entry.allocation.guaranteed = 0;
+    entry.allocation.demand = 0;
+    entry.allocation.active = false;
+    entry.shrink_count = 0;
+    add_member(entry);
+    return true;
+}
+
+
+// 线程池future的共享状态，结果只能设置一次
+template<class T> class pool_future_state
+{
+public:
+    static_assert(!::std::is_reference<T>::value, "pool_future does not support reference type");
+    typedef typename ::std::conditional<::std::is_void<T>::value, char, T>::type value_type;
+    typedef typename ::std::conditional<::std::is_void<T>::value, void, const value_type&>::type result_type;
+
+private:
+    ::std::mutex m_lock;
+    ::std::condition_variable m_cv;
+    ::std::atomic<bool> m_ready{ false };
+    bool m_has_value = false;
+    typename ::std::aligned_storage<sizeof(value_type), ::std::alignment_of<value_type>::value>::type m_value;
+    ::std::exception_ptr m_exception;
+    // 延续任务默认使用的调度器
+    pool_scheduler m_scheduler;
+    // 完成时调度的延续任务
+    ::std::vector<::std::pair<pool_scheduler, task_object>> m_continuations;
+
+    // 设置完成标志，在锁外调度所有延续任务
+    void complete(::std::unique_lock<::std::mutex>& lck)
+    {
+        decltype(m_continuations) continuations;
+        continuations.swap(m_continuations);
+        m_ready.store(true, ::std::memory_order_release);
         lck.unlock();
-        m_task_all++;
-        notify();
-        return ::std::make_pair(::std::move(future_obj), true);
+        m_cv.notify_all();
+        for (auto& continuation : continuations)
+            continuation.first(::std::move(continuation.second));
+    }
+    template<class Fn> void invoke(Fn& fn, ::std::true_type)
+    {
+        fn();
+        set_value();
+    }
+    template<class Fn> void invoke(Fn& fn, ::std::false_type)
+    {
+        set_value(fn());
+    }
+    void get_value(::std::true_type) const
+    {
+    }
+    const value_type& get_value(::std::false_type) const
+    {
+        return *reinterpret_cast<const value_type*>(&m_value);
+    }
+
+public:
+    pool_future_state(const pool_scheduler& scheduler) : m_scheduler(scheduler){}
+    pool_future_state(const pool_future_state&) = delete;
+    pool_future_state& operator=(const pool_future_state&) = delete;
+    ~pool_future_state()
+    {
+        if (m_has_value)
+            reinterpret_cast<value_type*>(&m_value)->~value_type();
+    }
+
+    template<class... Args> void set_value(Args&&... args)
+    {
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        if (m_ready.load(::std::memory_order_relaxed))
+            return;
+        new (&m_value) value_type(::std::forward<Args>(args)...);
+        m_has_value = true;
+        complete(lck);
+    }
+    void set_exception(::std::exception_ptr exception)
+    {
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        if (m_ready.load(::std::memory_order_relaxed))
+            return;
+        m_exception = ::std::move(exception);
+        complete(lck);
+    }
+    // 运行函数并设置结果或异常
+    template<class Fn> void run(Fn& fn)
+    {
+        try
+        {
+            invoke(fn, ::std::is_void<T>());
+        }
+        catch (...)
+        {
+            set_exception(::std::current_exception());
+        }
+    }
+    // 添加延续任务，已完成时立即调度
+    void add_continuation(const pool_scheduler& scheduler, task_object&& task)
+    {
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        if (!m_ready.load(::std::memory_order_relaxed))
+        {
+            m_continuations.emplace_back(scheduler, ::std::move(task));
+            return;
+        }
+        lck.unlock();
+        scheduler(::std::move(task));
+    }
+    const pool_scheduler& scheduler() const
+    {
+        return m_scheduler;
+    }
+    bool is_ready() const
+    {
+        return m_ready.load(::std::memory_order_acquire);
+    }
+    void wait()
+    {
+        if (is_ready())
+            return;
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        m_cv.wait(lck, [this]{ return m_ready.load(::std::memory_order_relaxed); });
+    }
+    template<class rep, class per>
+    ::std::future_status wait_for(const ::std::chrono::duration<rep, per>& rel_time)
+    {
+        // 已完成或者不等待时直接返回，不进入限时等待
+        if (is_ready())
+            return ::std::future_status::ready;
+        if (rel_time <= rel_time.zero())
+            return ::std::future_status::timeout;
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        return m_cv.wait_for(lck, rel_time, [this]{ return m_ready.load(::std::memory_order_relaxed); }) ? ::std::future_status::ready : ::std::future_status::timeout;
+    }
+    template<class clock, class dur>
+    ::std::future_status wait_until(const ::std::chrono::time_point<clock, dur>& abs_time)
+    {
+        ::std::unique_lock<::std::mutex> lck(m_lock);
+        return m_cv.wait_until(lck, abs_time, [this]{ return m_ready.load(::std::memory_order_relaxed); }) ? ::std::future_status::ready : ::std::future_status::timeout;
+    }
+    // 等待完成，有异常时重新抛出
+    result_type get()
+    {
+        wait();
+        if (m_exception)
+            ::std::rethrow_exception(m_exception);
+        return get_value(::std::is_void<T>());
     }
-    // 添加多个任务
-    template<class Fn, class... Args> bool push_multi(size_t count, Fn&& fn, Args&&... args)
+};
+
+// 设置线程池future结果的任务，未运行就被销毁（clear、stop）时设置broken_promise异常
+template<class T, class Fn> class pool_future_task
+{
+private:
+    ::std::shared_ptr<pool_future_state<T>> m_state;
+    Fn m_fn;
+
+public:
+    template<class F> pool_future_task(::std::shared_ptr<pool_future_state<T>> state, F&& fn)
+        : m_state(::std::move(state)), m_fn(::std::forward<F>(fn)){}
+    pool_future_task(pool_future_task&& other) noexcept(::std::is_nothrow_move_constructible<Fn>::value)
+        : m_state(::std::move(other.m_state)), m_fn(::std::move(other.m_fn)){}
+    pool_future_task(const pool_future_task&) = delete;
+    pool_future_task& operator=(const pool_future_task&) = delete;
+    ~pool_future_task()
     {
-        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
-        assert(count >= 0 && count < USHRT_MAX);
-        switch (m_exit_event.load())
+        if (m_state && !m_state->is_ready())
+            m_state->set_exception(broken_promise_exception());
+    }
+    void operator()()
+    {
+        m_state->run(m_fn);
+    }
+};
+
+// std::future的任务：共享状态从task_arena分配，未运行就销毁时future设置为broken_promise
+template<class T, class Fn> class future_task
+{
+private:
+    ::std::promise<T> m_promise;
+    Fn m_fn;
+
+    template<class R> static void set_result(::std::promise<R>& promise, Fn& fn)
+    {
+        promise.set_value(fn());
+    }
+    static void set_result(::std::promise<void>& promise, Fn& fn)
+    {
+        fn();
+        promise.set_value();
+    }
+
+public:
+    template<class F> explicit future_task(F&& fn)
+        : m_promise(::std::allocator_arg, arena_allocator<char>()), m_fn(::std::forward<F>(fn)){}
+#if defined(_MSC_VER) && _MSC_VER <= 1800
+    future_task(future_task&& other)
+        : m_promise(::std::move(other.m_promise)), m_fn(::std::move(other.m_fn)){}
+#else
+    future_task(future_task&&) = default;
+#endif
+    future_task(const future_task&) = delete;
+    future_task& operator=(const future_task&) = delete;
+    ::std::future<T> get_future()
+    {
+        return m_promise.get_future();
+    }
+    void operator()()
+    {
+        try
         {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
-            return false;
+            set_result(m_promise, m_fn);
         }
-        if (count)
+        catch (...)
         {
-            // 绑定函数
-            auto task_obj = ::std::make_shared<decltype(::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))>(
-                ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
-            // 生成任务（仿函数）
-            ::std::function<void()> bind_function(::std::bind(function_wapper(), ::std::move(task_obj)));
-            // 任务队列读写锁
-            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-            m_push_tasks->insert(m_push_tasks->end(), count, ::std::move(bind_function));
-            lck.unlock();
-            m_task_all += count;
-            notify(count);
+            m_promise.set_exception(::std::current_exception());
         }
-        return true;
     }
-    // 添加多个任务并返回返回值对象pair<vector<future>,bool>，使用future::get获取返回值（若未完成会等待完成）
-    template<class Fn, class... Args> auto push_multi_future(size_t count, Fn&& fn, Args&&... args)
-        -> ::std::pair<::std::vector<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>>, bool>
+};
+
+// 线程池future：可以复制（和shared_future相同），then添加的延续任务在结果就绪时调度到线程池，不占用等待线程
+template<class T> class pool_future
+{
+private:
+    ::std::shared_ptr<pool_future_state<T>> m_state;
+
+    // 延续函数，以就绪的future为参数
+    template<class Fn> struct continuation
     {
-        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
-        assert(count >= 0 && count < USHRT_MAX);
-        ::std::vector<::std::future<result_type>> future_obj;
-        switch (m_exit_event.load())
+        Fn fn;
+        pool_future source;
+        template<class F> continuation(F&& fn_arg, const pool_future& source_arg) : fn(::std::forward<F>(fn_arg)), source(source_arg){}
+        continuation(continuation&& other) : fn(::std::move(other.fn)), source(::std::move(other.source)){}
+        auto operator()() -> decltype(::std::declval<Fn&>()(::std::declval<pool_future&>()))
         {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
-            return ::std::make_pair(::std::move(future_obj), false);
+            return fn(source);
         }
-        if (count)
+    };
+    template<class Fn> auto then_on(const pool_scheduler& scheduler, Fn&& fn) const
+        -> pool_future<decltype(decay_type(::std::forward<Fn>(fn))(::std::declval<pool_future&>()))>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(::std::declval<pool_future&>())) result_type;
+        typedef continuation<typename ::std::decay<Fn>::type> continuation_type;
+        assert(valid()); // Future must be valid
+        auto state = ::std::allocate_shared<pool_future_state<result_type>>(arena_allocator<pool_future_state<result_type>>(), scheduler);
+        m_state->add_continuation(scheduler, task_object(pool_future_task<result_type, continuation_type>(
+            state, continuation_type(::std::forward<Fn>(fn), *this))));
+        return pool_future<result_type>(::std::move(state));
+    }
+
+public:
+    pool_future() = default;
+    explicit pool_future(::std::shared_ptr<pool_future_state<T>> state) : m_state(::std::move(state)){}
+
+    bool valid() const
+    {
+        return !!m_state;
+    }
+    bool is_ready() const
+    {
+        return m_state && m_state->is_ready();
+    }
+    // 等待完成并获取结果，有异常时重新抛出，可以多次调用
+    typename pool_future_state<T>::result_type get() const
+    {
+        return m_state->get();
+    }
+    void wait() const
+    {
+        m_state->wait();
+    }
+    template<class rep, class per>
+    ::std::future_status wait_for(const ::std::chrono::duration<rep, per>& rel_time) const
+    {
+        return m_state->wait_for(rel_time);
+    }
+    template<class clock, class dur>
+    ::std::future_status wait_until(const ::std::chrono::time_point<clock, dur>& abs_time) const
+    {
+        return m_state->wait_until(abs_time);
+    }
+    // 结果就绪时在产生此future的线程池中调用fn(future)，返回fn返回值的future
+    template<class Fn> auto then(Fn&& fn) const
+        -> pool_future<decltype(decay_type(::std::forward<Fn>(fn))(::std::declval<pool_future&>()))>
+    {
+        return then_on(m_state->scheduler(), ::std::forward<Fn>(fn));
+    }
+    // 结果就绪时在指定的线程池中调用fn(future)，返回fn返回值的future
+    template<bool handle_exception, class lock_type, class Fn> auto then(threadpool<handle_exception, lock_type>& pool, Fn&& fn) const
+        -> pool_future<decltype(decay_type(::std::forward<Fn>(fn))(::std::declval<pool_future&>()))>
+    {
+        return then_on(pool.scheduler(), ::std::forward<Fn>(fn));
+    }
+    // 结果就绪时在设置结果的线程中直接调用fn()，fn应只做轻量的工作（用于组合多个future）
+    template<class Fn> void on_ready(Fn&& fn) const
+    {
+        m_state->add_continuation(pool_scheduler(), task_object(::std::forward<Fn>(fn)));
+    }
+    // 获取延续任务默认使用的调度器
+    pool_scheduler get_scheduler() const
+    {
+        return m_state ? m_state->scheduler() : pool_scheduler();
+    }
+#ifdef THREADPOOL_COROUTINE
+    /* co_await future：结果就绪时通过产生此future的线程池恢复协程，不阻塞线程
+    *  恢复任务未运行就被清理时协程在清理的线程恢复，co_await抛出std::future_errc::broken_promise异常
+    **/
+    struct awaiter
+    {
+        ::std::shared_ptr<pool_future_state<T>> state;
+        bool cancelled = false;
+        bool await_ready() const noexcept
         {
-            future_obj.reserve(count);
-            while (count--)
-            {
-                // 绑定函数
-                auto task_obj = ::std::make_shared<::std::packaged_task<result_type()>>(
-                    ::std::bind(::std::forward<Fn>(fn), ::std::forward<Args>(args)...));
-                future_obj.push_back(task_obj->get_future());
-                // 生成任务（仿函数）
-                ::std::function<void()> bind_function(::std::bind(function_wapper(), ::std::move(task_obj)));
-                // 任务队列读写锁
-                ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock);
-                m_push_tasks->push_back(::std::move(bind_function));
-            }
-            m_task_all += count;
-            notify(count);
+            return state->is_ready();
         }
-        return ::std::make_pair(::std::move(future_obj), true);
+        void await_suspend(::std::coroutine_handle<> handle)
+        {
+            // 任务可能已经在其他线程恢复了协程，之后不能再访问等待对象
+            state->add_continuation(state->scheduler(), task_object(coroutine_resume_task(handle, &cancelled)));
+        }
+        typename pool_future_state<T>::result_type await_resume() const
+        {
+            if (cancelled)
+                ::std::rethrow_exception(broken_promise_exception());
+            return state->get();
+        }
+    };
+    awaiter operator co_await() const
+    {
+        assert(valid()); // Future must be valid
+        return awaiter{ m_state };
+    }
+#endif // #ifdef THREADPOOL_COROUTINE
+};
+
+// when_all计数器：每个future完成时减一，减到0时设置结果
+class when_all_counter
+{
+private:
+    ::std::atomic<size_t> m_remaining;
+    ::std::shared_ptr<pool_future_state<void>> m_result;
+
+public:
+    // 计数多1，所有future添加完成后再调用一次arrive
+    when_all_counter(size_t count, const pool_scheduler& scheduler)
+        : m_remaining(count + 1), m_result(::std::make_shared<pool_future_state<void>>(scheduler)){}
+    void arrive()
+    {
+        if (m_remaining.fetch_sub(1, ::std::memory_order_acq_rel) == 1)
+            m_result->set_value();
     }
-    // 添加一个任务集合
-    size_t push_tasks(const decltype(m_tasks)& tasks)
+    pool_future<void> get_future() const
     {
-        switch (m_exit_event.load())
+        return pool_future<void>(m_result);
+    }
+};
+
+inline pool_scheduler first_scheduler()
+{
+    return pool_scheduler();
+}
+template<class Future, class... Futures> pool_scheduler first_scheduler(const Future& future, const Futures&...)
+{
+    return future.get_scheduler();
+}
+template<class Future> void when_any_attach(const Future& future, const ::std::shared_ptr<pool_future_state<size_t>>& result, size_t index)
+{
+    future.on_ready([result, index]{ result->set_value(index); }); // 只有第一次设置生效
+}
+
+// 所有future完成时完成的future，由最后完成的future在其线程中设置，不占用等待线程; 各任务的异常保存在各自的future中
+template<class T> pool_future<void> when_all(const ::std::vector<pool_future<T>>& futures)
+{
+    auto counter = ::std::make_shared<when_all_counter>(futures.size(), futures.empty() ? pool_scheduler() : futures.front().get_scheduler());
+    for (auto& future : futures)
+        future.on_ready([counter]{ counter->arrive(); });
+    counter->arrive();
+    return counter->get_future();
+}
+template<class... Futures> pool_future<void> when_all(const Futures&... futures)
+{
+    auto counter = ::std::make_shared<when_all_counter>(sizeof...(Futures), first_scheduler(futures...));
+    int expand[] = { 0, (futures.on_ready([counter]{ counter->arrive(); }), 0)... };
+    (void)expand;
+    counter->arrive();
+    return counter->get_future();
+}
+
+// 任意一个future完成时完成的future，结果为最先完成的future的序号，没有future时为size_t(-1)
+template<class T> pool_future<size_t> when_any(const ::std::vector<pool_future<T>>& futures)
+{
+    auto result = ::std::make_shared<pool_future_state<size_t>>(futures.empty() ? pool_scheduler() : futures.front().get_scheduler());
+    if (futures.empty())
+        result->set_value((size_t)-1);
+    for (size_t i = 0; i < futures.size(); i++)
+        when_any_attach(futures[i], result, i);
+    return pool_future<size_t>(::std::move(result));
+}
+template<class... Futures> pool_future<size_t> when_any(const Futures&... futures)
+{
+    auto result = ::std::make_shared<pool_future_state<size_t>>(first_scheduler(futures...));
+    if (!sizeof...(Futures))
+        result->set_value((size_t)-1);
+    size_t index = 0;
+    int expand[] = { 0, (when_any_attach(futures, result, index++), 0)... };
+    (void)expand;
+    return pool_future<size_t>(::std::move(result));
+}
+
+
+// 批量任务共享状态：所有任务共用一个结果数组和完成计数，最后一个任务完成时唤醒等待的线程
+template<class T> class bulk_state
+{
+public:
+    static_assert(!::std::is_reference<T>::value, "bulk_future does not support reference type");
+    typedef typename ::std::conditional<::std::is_void<T>::value, char, T>::type value_type;
+    typedef typename ::std::conditional<::std::is_void<T>::value, void, const value_type&>::type result_type;
+
+    // 任务未运行就被销毁（clear、stop）时设置broken_promise异常
+    struct abandon
+    {
+        size_t index;
+        void operator()(bulk_state* state) const
         {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
-            return 0;
+            state->set_exception(index, broken_promise_exception());
         }
-        auto&& count = tasks.size();
-        if (count)
+    };
+
+private:
+    typedef typename ::std::aligned_storage<sizeof(value_type), ::std::alignment_of<value_type>::value>::type storage_type;
+    size_t m_count;
+    // 尚未完成的任务数
+    ::std::atomic<size_t> m_remaining;
+    // 任务结果，T为void时不分配
+    ::std::unique_ptr<storage_type[]> m_values;
+    // 失败的任务序号和异常，只在任务抛出异常时加锁添加
+    ::std::vector<::std::pair<size_t, ::std::exception_ptr>> m_exceptions;
+    spin_mutex m_exception_lock;
+    ::std::mutex m_wait_lock;
+    ::std::condition_variable m_wait_cv;
+    // 任务全部完成前保持状态有效，任务只保存状态指针，不增加引用计数
+    ::std::shared_ptr<bulk_state> m_self;
+
+    template<class Fn> void invoke(size_t index, Fn& fn, ::std::true_type)
+    {
+        fn();
+    }
+    template<class Fn> void invoke(size_t index, Fn& fn, ::std::false_type)
+    {
+        ::new (&m_values[index]) value_type(fn());
+    }
+    void get_value(size_t index, ::std::true_type) const
+    {
+    }
+    const value_type& get_value(size_t index, ::std::false_type) const
+    {
+        return *reinterpret_cast<const value_type*>(&m_values[index]);
+    }
+    // 一个任务完成，最后一个任务完成时唤醒等待的线程并释放自身引用
+    void complete()
+    {
+        if (m_remaining.fetch_sub(1, ::std::memory_order_acq_rel) != 1)
+            return;
+        ::std::shared_ptr<bulk_state> self;
         {
-            // 任务队列读写锁
-            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-            m_push_tasks->insert(m_push_tasks->end(), tasks.cbegin(), tasks.cend());
-            lck.unlock();
-            m_task_all += count;
-            notify(count);
+            ::std::lock_guard<::std::mutex> lck(m_wait_lock);
+            self.swap(m_self);
         }
-        return count;
+        m_wait_cv.notify_all();
     }
-    // 添加一个任务集合
-    size_t push_tasks(decltype(m_tasks)&& tasks)
+
+public:
+    explicit bulk_state(size_t count)
+        : m_count(count), m_remaining(count), m_values(::std::is_void<T>::value || !count ? nullptr : new storage_type[count]){}
+    bulk_state(const bulk_state&) = delete;
+    bulk_state& operator=(const bulk_state&) = delete;
+    ~bulk_state()
     {
-        switch (m_exit_event.load())
+        if (::std::is_void<T>::value || !m_values)
+            return;
+        ::std::vector<bool> failed(m_count);
+        for (auto& val : m_exceptions)
+            failed[val.first] = true;
+        for (size_t i = 0; i < m_count; i++)
+            if (!failed[i])
+                reinterpret_cast<value_type*>(&m_values[i])->~value_type();
+    }
+
+    // 添加任务前调用，任务全部完成前保持状态有效
+    void retain(const ::std::shared_ptr<bulk_state>& self)
+    {
+        if (m_count)
+            m_self = self;
+    }
+    // 运行第index个任务并设置结果或异常
+    template<class Fn> void run(size_t index, Fn& fn)
+    {
+        try
         {
-        case exit_event_t::NORMAL:
-        case exit_event_t::PAUSE:
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池仍然可以添加任务
-            break;
-        default: // 退出流程中禁止操作线程控制事件
-            return 0;
+            invoke(index, fn, ::std::is_void<T>());
         }
-        auto&& count = tasks.size();
-        if (count)
+        catch (...)
         {
-            // 任务队列读写锁
-            ::std::unique_lock<decltype(m_task_lock)> lck(m_task_lock);
-            while (!tasks.empty())
-            {
-                m_push_tasks->push_back(::std::move(tasks.front()));
-                tasks.pop_front();
-            }
-            lck.unlock();
-            m_task_all += count;
-            notify(count);
+            return set_exception(index, ::std::current_exception());
         }
-        return count;
+        complete();
     }
-
-    // 清理任务队列
-    void clear()
+    void set_exception(size_t index, ::std::exception_ptr exception)
     {
-        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock);
-        // 清理的任务从添加的任务总数中减去
-        m_task_all -= m_tasks.size();
-        m_task_all -= m_pause_tasks.size();
-        m_tasks.clear();
-        m_pause_tasks.clear();
+        {
+            ::std::lock_guard<spin_mutex> lck(m_exception_lock);
+            m_exceptions.emplace_back(index, ::std::move(exception));
+        }
+        complete();
     }
-    // 获取任务队列中的所有任务
-    decltype(m_tasks) get_tasks()
+    // 从first开始的任务没有生成，设置broken_promise异常
+    void abandon_from(size_t first)
     {
-        decltype(m_tasks) tasks;
-        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
-        m_task_all -= m_push_tasks->size();
-        m_push_tasks->swap(tasks);
-        return ::std::move(tasks);
+        for (size_t i = first; i < m_count; i++)
+            set_exception(i, broken_promise_exception());
     }
-
-    // 分离所有任务，分离的线程池对象线程数不变
-    void detach()
+    size_t size() const
     {
-        detach(m_thread_started);
+        return m_count;
     }
-    // 分离所有任务，设置分离的线程池对象线程数为thread_number_new
-    SYSCONAPI void detach(int thread_number_new);
-    // 分离任务，并得到分离任务执行情况的future
-    ::std::future<size_t> detach_future()
+    size_t get_remaining() const
     {
-        return detach_future(m_thread_started);
+        return m_remaining.load(::std::memory_order_acquire);
     }
-    // 分离任务，设置分离的线程池对象线程数为thread_number_new，并得到分离任务执行情况的future
-    SYSCONAPI ::std::future<size_t> detach_future(int thread_number_new);
-    // 销毁线程池。WARNING: 线程会被直接分离，可能会造成资源泄露!!!
-    SYSCONAPI void destroy();
-
-    // 获取线程数量
-    int get_thread_number() const
+    void wait()
     {
-        return m_thread_started.load();
+        if (!get_remaining())
+            return;
+        ::std::unique_lock<::std::mutex> lck(m_wait_lock);
+        m_wait_cv.wait(lck, [this]{ return !get_remaining(); });
     }
-    // 获取空闲线程数
-    int get_free_thread_number() const
+    template<class rep, class per>
+    ::std::future_status wait_for(const ::std::chrono::duration<rep, per>& rel_time)
     {
-        if (get_tasks_number())
-            return 0;
-        else
-        {
-            size_t run_tasks = get_tasks_total_number() - get_tasks_completed_number();
-            int thread_num = get_thread_number();
-            return (int)run_tasks >= thread_num ? 0 : thread_num - (int)run_tasks;
-        }
+        // 已完成或者不等待时直接返回，不进入限时等待
+        if (!get_remaining())
+            return ::std::future_status::ready;
+        if (rel_time <= rel_time.zero())
+            return ::std::future_status::timeout;
+        ::std::unique_lock<::std::mutex> lck(m_wait_lock);
+        return m_wait_cv.wait_for(lck, rel_time, [this]{ return !get_remaining(); }) ? ::std::future_status::ready : ::std::future_status::timeout;
     }
-    // 获取任务队列数量
-    size_t get_tasks_number() const
+    template<class clock, class dur>
+    ::std::future_status wait_until(const ::std::chrono::time_point<clock, dur>& abs_time)
+    {
+        ::std::unique_lock<::std::mutex> lck(m_wait_lock);
+        return m_wait_cv.wait_until(lck, abs_time, [this]{ return !get_remaining(); }) ? ::std::future_status::ready : ::std::future_status::timeout;
+    }
+    // 等待全部完成，获取第index个任务的异常，没有异常时为nullptr
+    ::std::exception_ptr get_exception(size_t index)
+    {
+        wait();
+        for (auto& val : m_exceptions)
+            if (val.first == index)
+                return val.second;
+        return nullptr;
+    }
+    // 获取抛出异常（包括未运行）的任务数
+    size_t get_exception_number()
+    {
+        wait();
+        return m_exceptions.size();
+    }
+    // 等待全部完成并获取第index个任务的结果，有异常时重新抛出
+    result_type get(size_t index)
+    {
+        assert(index < m_count); // Index out of range
+        auto exception = get_exception(index);
+        if (exception)
+            ::std::rethrow_exception(exception);
+        return get_value(index, ::std::is_void<T>());
+    }
+};
+
+// 批量任务：只保存共享状态指针和序号，可以无异常移动时直接存储在任务对象内部
+template<class T, class Fn> class bulk_task
+{
+private:
+    ::std::unique_ptr<bulk_state<T>, typename bulk_state<T>::abandon> m_state;
+    Fn m_fn;
+
+public:
+    template<class F> bulk_task(bulk_state<T>* state, size_t index, F&& fn)
+        : m_state(state, typename bulk_state<T>::abandon{ index }), m_fn(::std::forward<F>(fn)){}
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // VS2012,VS2013不会生成移动构造函数
+    bulk_task(bulk_task&& other) : m_state(::std::move(other.m_state)), m_fn(::std::move(other.m_fn)){}
+#endif // #if _MSC_VER <= 1800
+    void operator()()
+    {
+        auto index = m_state.get_deleter().index;
+        m_state.release()->run(index, m_fn);
+    }
+};
+
+// 批量任务的结果：所有任务共享一个状态，可以复制; 全部任务完成后才能获取结果
+template<class T> class bulk_future
+{
+private:
+    ::std::shared_ptr<bulk_state<T>> m_state;
+
+public:
+    bulk_future() = default;
+    explicit bulk_future(::std::shared_ptr<bulk_state<T>> state) : m_state(::std::move(state)){}
+
+    bool valid() const
     {
-        ::std::lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
-        return m_push_tasks->size();
+        return !!m_state;
     }
-    // 获取异常任务数
-    size_t get_tasks_exception_number() const
+    // 任务数
+    size_t size() const
     {
-        return m_task_exception.load();
+        return m_state ? m_state->size() : 0;
     }
-    // 获取已完成任务数
-    size_t get_tasks_completed_number() const
+    // 尚未完成的任务数
+    size_t get_remaining() const
     {
-        return m_task_completed.load();
+        return m_state ? m_state->get_remaining() : 0;
     }
-    // 获取已添加任务总数
-    size_t get_tasks_total_number() const
+    bool is_ready() const
     {
-        return m_task_all.load();
+        return m_state && !m_state->get_remaining();
     }
-
-    // 获取异常任务队列
-    decltype(m_tasks) get_exception_tasks()
+    void wait() const
     {
-        decltype(m_tasks) exception_tasks;
-        m_exception_tasks.swap(exception_tasks);
-        return ::std::move(exception_tasks);
+        m_state->wait();
     }
-    // 获取初始化线程数
-    int get_default_thread_number() const
+    template<class rep, class per>
+    ::std::future_status wait_for(const ::std::chrono::duration<rep, per>& rel_time) const
     {
-        return m_thread_number.load();
+        return m_state->wait_for(rel_time);
     }
-    // 获取类型信息
-    static const type_info& this_type()
+    template<class clock, class dur>
+    ::std::future_status wait_until(const ::std::chrono::time_point<clock, dur>& abs_time) const
     {
-        return typeid(threadpool);
+        return m_state->wait_until(abs_time);
     }
-
-    // 初始化线程池，设置处理线程数，已初始化则失败
-    SYSCONAPI bool set_thread_number(int thread_number);
-    // 初始化线程池，设置处理线程数，已初始化则失败，线程启动时先执行一次启动函数
-    template<class Fn, class... Args> bool set_thread_number(int thread_number, Fn&& startup_fn, Args&&... args)
+    // 等待全部完成并获取第index个任务的结果，有异常时重新抛出，可以多次调用
+    typename bulk_state<T>::result_type get(size_t index) const
     {
-        assert(thread_number >= 0 && thread_number < 255); // Thread number must greater than or equal 0 and less than 255
-        switch (m_exit_event.load())
-        {
-        case exit_event_t::INITIALIZATION: // 未初始化的线程池
-            m_exit_event = exit_event_t::NORMAL;
-            m_stop_thread = CreateEventW(nullptr, TRUE, FALSE, nullptr);  // 手动复位，无信号
-            m_notify_task = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
-            break;
-        default: // 已初始化的线程池将失败
-            return false;
-        }
-        if (thread_number < 0)
-            return false;
-        m_thread_number = thread_number;
-        return set_new_thread_number(thread_number, ::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...);
+        return m_state->get(index);
     }
-    // 设置新的处理线程数，退出流程和未初始化的线程池则失败
-    SYSCONAPI bool set_new_thread_number(int thread_number_new);
-    // 设置新的处理线程数，退出流程和未初始化的线程池则失败，线程启动时先执行一次启动函数
-    template<class Fn, class... Args> bool set_new_thread_number(int thread_number_new, Fn&& startup_fn, Args&&... args)
+    // 等待全部完成并获取第index个任务的异常，没有异常时为nullptr
+    ::std::exception_ptr get_exception(size_t index) const
     {
-        // 绑定函数
-        auto task_obj = ::std::make_shared<decltype(::std::bind(::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...))>(
-            ::std::bind(::std::forward<Fn>(startup_fn), ::std::forward<Args>(args)...));
-        // 生成任务（仿函数）
-        ::std::function<void()> bind_function(::std::bind(function_wapper(), ::std::move(task_obj)));
-        return _set_new_thread_number(thread_number_new, ::std::move(bind_function));
+        return m_state->get_exception(index);
     }
-
-    // 重置线程池数量为初始数量
-    bool reset_thread_number()
+    // 等待全部完成并获取抛出异常（包括未运行）的任务数
+    size_t get_exception_number() const
     {
-        return set_new_thread_number(get_default_thread_number());
+        return m_state->get_exception_number();
     }
+};
 
-    // 设置线程优先级
-    SYSCONAPI void set_thread_priority(thread_priority priority = thread_priority::uninitialized);
-    // 检查运行的线程是否为线程池管理的线程
-    bool is_owner()
-    {
-        return is_owner(::std::this_thread::get_id());
-    }
-    // 检查指定的线程ID是否为线程池管理的线程
-    bool is_owner(const ::std::thread::id& thread_id)
+
+#ifdef THREADPOOL_COROUTINE
+// 在线程池中运行协程任务，结果保存到pool_future
+template<class T, bool handle_exception, class lock_type> coroutine_detached coroutine_start(threadpool<handle_exception, lock_type>* pool, coroutine_task<T> task, ::std::shared_ptr<pool_future_state<T>> state)
+{
+    try
     {
-        // 线程创建、销毁事件锁
-        ::std::unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
-        if (::std::any_of(m_thread_object.cbegin(), m_thread_object.cend(), [&](decltype(*m_thread_object.cend()) th_obj){ return thread_id == ::std::get<0>(th_obj).get_id(); }))
-            return true;
-        if (::std::any_of(m_thread_destroy.cbegin(), m_thread_destroy.cend(), [&](decltype(*m_thread_destroy.cend()) th_obj){ return thread_id == ::std::get<0>(th_obj).get_id(); }))
-            return true;
-        return false;
+        co_await pool->schedule();
+        if constexpr (::std::is_void<T>::value)
+        {
+            co_await task;
+            state->set_value();
+        }
+        else
+            state->set_value(co_await task);
     }
-    bool is_start() const
+    catch (...)
     {
-        return m_is_start;
+        state->set_exception(::std::current_exception());
     }
-};
+}
+#endif // #ifdef THREADPOOL_COROUTINE
 
 
 // 自动等待输入的future完成
@@ -568,6 +4201,8 @@ private:
     ::std::vector<::std::future<future_type>> future_set;
     // 等待的shared_future集合
     ::std::vector<::std::shared_future<future_type>> shared_future_set;
+    // 等待的pool_future集合
+    ::std::vector<pool_future<future_type>> pool_future_set;
 
 public:
     auto_wait_future() = default;
@@ -628,14 +4263,30 @@ public:
         return ::std::move(result);
     }
 
+    pool_future<future_type> push(const pool_future<future_type>& fut)
+    {
+        pool_future_set.push_back(fut);
+        return fut;
+    }
+    pool_future<future_type> push(const ::std::pair<pool_future<future_type>, bool>& fut)
+    {
+        if (fut.second)
+            pool_future_set.push_back(fut.first);
+        return fut.first;
+    }
+
+    // 在线程池的线程中等待时运行所属线程池的其他任务
     void wait() const
     {
         for (auto& val : future_set)
             if (val.valid())
-                val.wait();
+                help_wait(val);
         for (auto& val : shared_future_set)
             if (val.valid())
-                val.wait();
+                help_wait(val);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                help_wait(val);
     }
     template<class rep, class per>
     void wait_for(const ::std::chrono::duration<rep, per>& rel_time) const
@@ -646,6 +4297,9 @@ public:
         for (auto& val : shared_future_set)
             if (val.valid())
                 val.wait_for(rel_time);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                val.wait_for(rel_time);
     }
     template<class clock, class dur>
     void wait_until(const ::std::chrono::time_point<clock, dur>& abs_time) const
@@ -656,12 +4310,16 @@ public:
         for (auto& val : shared_future_set)
             if (val.valid())
                 val.wait_until(abs_time);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                val.wait_until(abs_time);
     }
 
     void clear()
     {
         future_set.clear();
         shared_future_set.clear();
+        pool_future_set.clear();
     }
     void clear_on_complete()
     {
@@ -678,6 +4336,8 @@ class auto_wait_shared_future
 private:
     // 等待的shared_future集合
     ::std::vector<::std::shared_future<future_type>> future_set;
+    // 等待的pool_future集合
+    ::std::vector<pool_future<future_type>> pool_future_set;
 
 public:
     auto_wait_shared_future() = default;
@@ -745,11 +4405,27 @@ public:
         return ::std::move(result);
     }
 
+    pool_future<future_type> push(const pool_future<future_type>& fut)
+    {
+        pool_future_set.push_back(fut);
+        return fut;
+    }
+    pool_future<future_type> push(const ::std::pair<pool_future<future_type>, bool>& fut)
+    {
+        if (fut.second)
+            pool_future_set.push_back(fut.first);
+        return fut.first;
+    }
+
+    // 在线程池的线程中等待时运行所属线程池的其他任务
     void wait() const
     {
         for (auto& val : future_set)
             if (val.valid())
-                val.wait();
+                help_wait(val);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                help_wait(val);
     }
     template<class rep, class per>
     void wait_for(const ::std::chrono::duration<rep, per>& rel_time) const
@@ -757,6 +4433,9 @@ public:
         for (auto& val : future_set)
             if (val.valid())
                 val.wait_for(rel_time);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                val.wait_for(rel_time);
     }
     template<class clock, class dur>
     void wait_until(const ::std::chrono::time_point<clock, dur>& abs_time) const
@@ -764,11 +4443,15 @@ public:
         for (auto& val : future_set)
             if (val.valid())
                 val.wait_until(abs_time);
+        for (auto& val : pool_future_set)
+            if (val.valid())
+                val.wait_until(abs_time);
     }
 
     void clear()
     {
         future_set.clear();
+        pool_future_set.clear();
     }
     void clear_on_complete()
     {
@@ -805,6 +4488,28 @@ public:
     {
         return m_thpool_true || m_thpool_false;
     }
+    // 添加任务
+    template<class Fn, class... Args> bool push(Fn&& fn, Args&&... args)
+    {
+        if (m_thpool_true)
+            return m_thpool_true->push(::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+        else if (m_thpool_false)
+            return m_thpool_false->push(::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+        else
+            return false;
+    }
+    // 添加任务，并得到任务返回值的future
+    template<class Fn, class... Args> auto push_future(Fn&& fn, Args&&... args)
+        -> ::std::pair<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        if (m_thpool_true)
+            return m_thpool_true->push_future(::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+        else if (m_thpool_false)
+            return m_thpool_false->push_future(::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+        else
+            return ::std::make_pair(::std::future<result_type>(), false);
+    }
     // 清理任务队列
     void clear()
     {
@@ -843,6 +4548,16 @@ public:
         else
             return 0;
     }
+    // 不加锁地估计任务队列数量
+    size_t get_tasks_number_estimate() const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_tasks_number_estimate();
+        else if (m_thpool_false)
+            return m_thpool_false->get_tasks_number_estimate();
+        else
+            return 0;
+    }
     // 获取异常任务数
     size_t get_tasks_exception_number() const
     {
@@ -863,6 +4578,16 @@ public:
         else
             return 0;
     }
+    // 获取已取消的任务数
+    size_t get_tasks_cancelled_number() const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_tasks_cancelled_number();
+        else if (m_thpool_false)
+            return m_thpool_false->get_tasks_cancelled_number();
+        else
+            return 0;
+    }
     // 获取已添加任务总数
     size_t get_tasks_total_number() const
     {
@@ -883,6 +4608,58 @@ public:
         else
             return 0;
     }
+    // 获取指定优先级的任务队列数量
+    size_t get_tasks_number(task_priority priority) const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_tasks_number(priority);
+        else if (m_thpool_false)
+            return m_thpool_false->get_tasks_number(priority);
+        else
+            return 0;
+    }
+    // 获取指定优先级已添加任务总数
+    size_t get_tasks_total_number(task_priority priority) const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_tasks_total_number(priority);
+        else if (m_thpool_false)
+            return m_thpool_false->get_tasks_total_number(priority);
+        else
+            return 0;
+    }
+    // 获取指定优先级因老化提前调度的任务数
+    size_t get_tasks_aged_number(task_priority priority) const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_tasks_aged_number(priority);
+        else if (m_thpool_false)
+            return m_thpool_false->get_tasks_aged_number(priority);
+        else
+            return 0;
+    }
+#ifdef THREADPOOL_HISTOGRAM
+    // 获取任务排队延迟和运行时间直方图快照
+    task_histogram_snapshot get_task_histogram() const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_task_histogram();
+        else if (m_thpool_false)
+            return m_thpool_false->get_task_histogram();
+        else
+            return task_histogram_snapshot();
+    }
+    // 获取按任务对象类型统计的直方图快照
+    ::std::vector<::std::pair<::std::string, task_histogram_snapshot>> get_type_histograms() const
+    {
+        if (m_thpool_true)
+            return m_thpool_true->get_type_histograms();
+        else if (m_thpool_false)
+            return m_thpool_false->get_type_histograms();
+        else
+            return ::std::vector<::std::pair<::std::string, task_histogram_snapshot>>();
+    }
+#endif
 };
 
 // 设置线程池指针(threadpool<true>)
@@ -924,6 +4701,19 @@ public:
     {
         return !m_thpool.empty();
     }
+    // 线程池数量和按添加顺序访问单个线程池
+    size_t size() const
+    {
+        return m_thpool.size();
+    }
+    threadpool_view& operator[](size_t index)
+    {
+        return m_thpool[index];
+    }
+    const threadpool_view& operator[](size_t index) const
+    {
+        return m_thpool[index];
+    }
     // 清空管理的指针
     void clear_pointer()
     {
@@ -959,6 +4749,14 @@ public:
             result += th.get_tasks_number();
         return result;
     }
+    // 不加锁地估计任务队列数量
+    size_t get_tasks_number_estimate() const
+    {
+        size_t result = 0;
+        for (auto& th : m_thpool)
+            result += th.get_tasks_number_estimate();
+        return result;
+    }
     // 获取异常任务数
     size_t get_tasks_exception_number() const
     {
@@ -975,6 +4773,14 @@ public:
             result += th.get_tasks_completed_number();
         return result;
     }
+    // 获取已取消的任务数
+    size_t get_tasks_cancelled_number() const
+    {
+        size_t result = 0;
+        for (auto& th : m_thpool)
+            result += th.get_tasks_cancelled_number();
+        return result;
+    }
     // 获取已添加任务总数
     size_t get_tasks_total_number() const
     {
@@ -991,4 +4797,255 @@ public:
             result += th.get_default_thread_number();
         return result;
     }
+#ifdef THREADPOOL_HISTOGRAM
+    // 获取任务排队延迟和运行时间直方图快照，合并所有线程池的记录
+    task_histogram_snapshot get_task_histogram() const
+    {
+        task_histogram_snapshot result;
+        for (auto& th : m_thpool)
+            result.merge(th.get_task_histogram());
+        return result;
+    }
+    // 获取按任务对象类型统计的直方图快照，相同类型合并
+    ::std::vector<::std::pair<::std::string, task_histogram_snapshot>> get_type_histograms() const
+    {
+        ::std::vector<::std::pair<::std::string, task_histogram_snapshot>> result;
+        for (auto& th : m_thpool)
+        {
+            for (auto& item : th.get_type_histograms())
+            {
+                auto iter = ::std::find_if(result.begin(), result.end(),
+                    [&item](const ::std::pair<::std::string, task_histogram_snapshot>& val){ return val.first == item.first; });
+                if (iter == result.end())
+                    result.push_back(item);
+                else
+                    iter->second.merge(item.second);
+            }
+        }
+        return result;
+    }
+#endif
+};
+
+
+// 分发策略
+enum class dispatch_policy
+{
+    round_robin,            // 轮流添加
+    least_loaded,           // 比较所有线程池，添加到估计的等待时间最短的线程池
+    power_of_two_choices,   // 随机选择两个线程池，添加到估计的等待时间较短的一个
+};
+
+/* 多个线程池的任务分发器：按估计的等待时间选择线程池，选择过程不加锁
+*  每个线程池的负载（排队和正在运行的任务数）和平均运行时间按刷新间隔从任务计数更新，由添加任务的线程更新，
+*  间隔内分发器添加的任务计入负载; 估计的等待时间为超出空闲线程的任务数*平均运行时间/线程数
+*  线程池须在分发器之后销毁，分发器创建后添加到多线程池展示的线程池不参与分发
+**/
+class threadpool_dispatcher
+{
+private:
+    // 一个线程池的负载估计，独占缓存行
+    struct pool_load
+    {
+        // 上一次刷新的时间（纳秒），刷新的线程先修改此值
+        ::std::atomic<long long> refresh_time;
+        // 上一次刷新时的排队和正在运行的任务数、线程数、已结束任务数
+        ::std::atomic<size_t> backlog;
+        ::std::atomic<int> thread_number;
+        ::std::atomic<size_t> finished;
+        // 上一次刷新后分发的任务数
+        ::std::atomic<size_t> dispatched;
+        // 平均每个任务的运行时间（纳秒），0为未知
+        ::std::atomic<uint64_t> service_time;
+        // 分发的任务总数
+        ::std::atomic<size_t> dispatched_total;
+        char padding[sharded_counter::cache_line_size];
+    };
+    threadpool_multi_view m_view;
+    ::std::unique_ptr<pool_load[]> m_loads;
+    dispatch_policy m_policy;
+    long long m_refresh_interval;
+    ::std::atomic<size_t> m_next{ 0 };
+    // 所有线程池的平均运行时间，用于还没有结束任务的线程池
+    ::std::atomic<uint64_t> m_service_time{ 0 };
+
+    static long long now()
+    {
+        return ::std::chrono::duration_cast<::std::chrono::nanoseconds>(::std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // 当前线程的随机数（xorshift），第一次使用时由线程ID散列得到
+    static uint64_t next_random()
+    {
+        static thread_local uint64_t state = 0;
+        if (!state)
+            state = (uint64_t)::std::hash<::std::thread::id>()(::std::this_thread::get_id()) * 0x9E3779B97F4A7C15ull | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    // 超过刷新间隔时从任务计数更新负载估计，同时只有一个线程刷新
+    void refresh(size_t index, long long time)
+    {
+        auto& load = m_loads[index];
+        auto last_time = load.refresh_time.load(::std::memory_order_relaxed);
+        if (time - last_time < m_refresh_interval || !load.refresh_time.compare_exchange_strong(last_time, time, ::std::memory_order_relaxed))
+            return;
+        auto& view = m_view[index];
+        size_t queue_depth = view.get_tasks_number_estimate();
+        size_t finished = view.get_tasks_completed_number() + view.get_tasks_exception_number() + view.get_tasks_cancelled_number();
+        size_t total = view.get_tasks_total_number();
+        size_t backlog = total > queue_depth + finished ? total - finished : queue_depth;
+        int thread_number = view.get_thread_number();
+        // 平均运行时间：间隔内繁忙的线程数*间隔时间/结束的任务数，指数加权平均
+        auto last_finished = load.finished.exchange(finished, ::std::memory_order_relaxed);
+        auto last_backlog = load.backlog.load(::std::memory_order_relaxed);
+        if (last_time && finished > last_finished && finished - last_finished < (SIZE_MAX >> 1))
+        {
+            auto busy = auto_max(auto_min(last_backlog, (size_t)auto_max(thread_number, 0)), (size_t)1);
+            auto sample = (uint64_t)(time - last_time) * busy / (finished - last_finished);
+            auto service_time = load.service_time.load(::std::memory_order_relaxed);
+            load.service_time.store(service_time ? (service_time * 7 + sample) / 8 : sample, ::std::memory_order_relaxed);
+            service_time = m_service_time.load(::std::memory_order_relaxed);
+            m_service_time.store(service_time ? (service_time * 7 + sample) / 8 : sample, ::std::memory_order_relaxed);
+        }
+        load.backlog.store(backlog, ::std::memory_order_relaxed);
+        load.thread_number.store(thread_number, ::std::memory_order_relaxed);
+        load.dispatched.store(0, ::std::memory_order_relaxed);
+    }
+    // 线程池的负载评分，越小越好：有空闲线程时为负的空闲线程数，否则为估计的等待时间
+    double score(size_t index) const
+    {
+        auto& load = m_loads[index];
+        int thread_number = load.thread_number.load(::std::memory_order_relaxed);
+        if (thread_number <= 0)
+            return 1e300;
+        auto pending = (double)(load.backlog.load(::std::memory_order_relaxed) + load.dispatched.load(::std::memory_order_relaxed));
+        auto excess = pending + 1 - thread_number;
+        if (excess <= 0)
+            return excess;
+        auto service_time = load.service_time.load(::std::memory_order_relaxed);
+        if (!service_time)
+            service_time = m_service_time.load(::std::memory_order_relaxed);
+        return excess * (double)(service_time ? service_time : 1) / thread_number;
+    }
+
+public:
+    explicit threadpool_dispatcher(const threadpool_multi_view& view, dispatch_policy policy = dispatch_policy::least_loaded,
+        ::std::chrono::microseconds refresh_interval = ::std::chrono::microseconds(100))
+        : m_view(view), m_loads(new pool_load[view.size()]), m_policy(policy),
+        m_refresh_interval(::std::chrono::duration_cast<::std::chrono::nanoseconds>(refresh_interval).count())
+    {
+        auto time = now();
+        for (size_t i = 0; i < m_view.size(); i++)
+        {
+            auto& load = m_loads[i];
+            load.refresh_time = 0;
+            load.backlog = 0;
+            load.thread_number = 0;
+            load.finished = 0;
+            load.dispatched = 0;
+            load.service_time = 0;
+            load.dispatched_total = 0;
+            refresh(i, time);
+        }
+    }
+    threadpool_dispatcher(const threadpool_dispatcher&) = delete;
+    threadpool_dispatcher& operator=(const threadpool_dispatcher&) = delete;
+
+    // 按分发策略选择线程池，返回序号; 没有线程池时返回size()
+    size_t select()
+    {
+        size_t number = m_view.size();
+        if (number <= 1)
+            return 0;
+        if (m_policy == dispatch_policy::round_robin)
+            return m_next.fetch_add(1, ::std::memory_order_relaxed) % number;
+        auto time = now();
+        if (m_policy == dispatch_policy::power_of_two_choices)
+        {
+            auto random = next_random();
+            size_t first = (size_t)(random % number);
+            size_t second = (first + 1 + (size_t)((random >> 32) % (number - 1))) % number;
+            refresh(first, time);
+            refresh(second, time);
+            return score(second) < score(first) ? second : first;
+        }
+        // 从轮流的位置开始比较，评分相同时分散到不同的线程池
+        size_t start = m_next.fetch_add(1, ::std::memory_order_relaxed);
+        size_t result = start % number;
+        refresh(result, time);
+        double result_score = score(result);
+        for (size_t i = 1; i < number; i++)
+        {
+            size_t index = (start + i) % number;
+            refresh(index, time);
+            double index_score = score(index);
+            if (index_score < result_score)
+            {
+                result = index;
+                result_score = index_score;
+            }
+        }
+        return result;
+    }
+    // 添加任务到选择的线程池
+    template<class Fn, class... Args> bool push(Fn&& fn, Args&&... args)
+    {
+        size_t index = select();
+        if (index >= m_view.size())
+            return false;
+        m_loads[index].dispatched.fetch_add(1, ::std::memory_order_relaxed);
+        if (!m_view[index].push(::std::forward<Fn>(fn), ::std::forward<Args>(args)...))
+        {
+            m_loads[index].dispatched.fetch_sub(1, ::std::memory_order_relaxed);
+            return false;
+        }
+        m_loads[index].dispatched_total.fetch_add(1, ::std::memory_order_relaxed);
+        return true;
+    }
+    // 添加任务到选择的线程池，并得到任务返回值的future
+    template<class Fn, class... Args> auto push_future(Fn&& fn, Args&&... args)
+        -> ::std::pair<::std::future<decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...))>, bool>
+    {
+        typedef decltype(decay_type(::std::forward<Fn>(fn))(decay_type(::std::forward<Args>(args))...)) result_type;
+        size_t index = select();
+        if (index >= m_view.size())
+            return ::std::make_pair(::std::future<result_type>(), false);
+        m_loads[index].dispatched.fetch_add(1, ::std::memory_order_relaxed);
+        auto result = m_view[index].push_future(::std::forward<Fn>(fn), ::std::forward<Args>(args)...);
+        if (result.second)
+            m_loads[index].dispatched_total.fetch_add(1, ::std::memory_order_relaxed);
+        else
+            m_loads[index].dispatched.fetch_sub(1, ::std::memory_order_relaxed);
+        return result;
+    }
+    // 线程池数量
+    size_t size() const
+    {
+        return m_view.size();
+    }
+    dispatch_policy get_policy() const
+    {
+        return m_policy;
+    }
+    // 获取线程池估计的等待时间（上一次刷新的负载加上之后分发的任务数）
+    ::std::chrono::nanoseconds get_expected_wait(size_t index) const
+    {
+        auto value = score(index);
+        return ::std::chrono::nanoseconds(value <= 0 ? 0 : value >= 9e18 ? LLONG_MAX : (long long)value);
+    }
+    // 获取线程池平均每个任务的运行时间，未知时为0
+    ::std::chrono::nanoseconds get_service_time(size_t index) const
+    {
+        return ::std::chrono::nanoseconds((long long)m_loads[index].service_time.load());
+    }
+    // 获取分发到每个线程池的任务总数
+    ::std::vector<size_t> get_dispatched_numbers() const
+    {
+        ::std::vector<size_t> result;
+        for (size_t i = 0; i < m_view.size(); i++)
+            result.push_back(m_loads[i].dispatched_total.load());
+        return result;
+    }
 };
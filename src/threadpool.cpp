@@ -1,84 +1,779 @@
 ﻿/**********************************************************
 * 线程池控制类（生成宏）
-* 支持平台：Windows
-* 编译环境：VS2013+
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
 ***********************************************************/
 
 #include "threadpool.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32) || defined(WIN32)
+#else // UNIX
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#endif // #if defined(_WIN32) || defined(WIN32)
 
 using namespace std;
 
-// 线程运行前准备，捕获异常
-template<> inline size_t threadpool<true>::pre_run(HANDLE pause_event, HANDLE resume_event)
+// 当前线程的帮助运行上下文
+help_context& this_help_context()
 {
-    while (true)
+    static thread_local help_context context = { nullptr, nullptr, 0 };
+    return context;
+}
+
+// 任务分配器的大小分类：每类的块大小（包括块头），块数为缓存槽数
+static const size_t arena_class_size[] = { 64, 128, 256, 512, 1024 };
+static const size_t arena_class_number = sizeof(arena_class_size) / sizeof(arena_class_size[0]);
+static const size_t arena_slot_number = 64;
+static const size_t arena_slab_size = 64 * 1024;
+static const size_t arena_remote_batch = 32;
+static const uint32_t arena_large_class = (uint32_t)-1;
+
+// 块头：所属缓存槽和大小分类，空闲时块内保存下一个空闲块
+struct arena_block
+{
+    uint32_t slot;
+    uint32_t size_class;
+    arena_block* next;
+};
+static_assert(sizeof(arena_block) <= task_arena::alignment, "arena block header must fit in alignment");
+
+// 缓存槽：线程按序号使用不同的缓存槽，超过缓存槽数的线程共享; 锁只在共享缓存槽的线程之间竞争
+struct arena_slot
+{
+    spin_mutex lock;
+    arena_block* free_list[arena_class_number];
+    // 其他线程批量归还的块，不区分大小分类，分配时取出
+    atomic<arena_block*> remote;
+    // 释放的其他缓存槽的块，按所属缓存槽保存，满一批后归还
+    arena_block* pending_head[arena_slot_number];
+    arena_block* pending_tail[arena_slot_number];
+    size_t pending_count[arena_slot_number];
+    // 统计，缓存槽锁内修改
+    atomic<size_t> allocations;
+    atomic<size_t> deallocations;
+    atomic<size_t> remote_frees;
+    atomic<size_t> remote_batches;
+    atomic<size_t> slab_allocations;
+    atomic<size_t> large_allocations;
+    char padding[64];
+};
+static arena_slot g_arena_slots[arena_slot_number];
+static atomic<size_t> g_arena_next_slot{ 0 };
+static atomic<bool> g_arena_enabled{ false };
+
+// 将缓存槽中保存的owner的块一次归还给所属缓存槽，须在缓存槽锁内调用
+static void arena_flush(arena_slot& slot, size_t owner)
+{
+    auto& owner_slot = g_arena_slots[owner];
+    auto head = owner_slot.remote.load(memory_order_relaxed);
+    do
     {
-        try
+        slot.pending_tail[owner]->next = head;
+    } while (!owner_slot.remote.compare_exchange_weak(head, slot.pending_head[owner], memory_order_release, memory_order_relaxed));
+    slot.pending_head[owner] = nullptr;
+    slot.pending_tail[owner] = nullptr;
+    slot.pending_count[owner] = 0;
+    slot.remote_batches.fetch_add(1, memory_order_relaxed);
+}
+
+// 线程的缓存槽序号，线程退出时归还缓存槽中保存的其他缓存槽的块，不等待缓存槽被复用
+struct arena_thread
+{
+    size_t slot = 0; // 序号+1，0为未分配
+    ~arena_thread()
+    {
+        if (!slot)
+            return;
+        auto& this_slot = g_arena_slots[slot - 1];
+        lock_guard<spin_mutex> lck(this_slot.lock);
+        for (size_t owner = 0; owner < arena_slot_number; owner++)
+        {
+            if (this_slot.pending_head[owner])
+                arena_flush(this_slot, owner);
+        }
+    }
+};
+
+// 当前线程使用的缓存槽序号，第一次使用时按顺序分配
+static size_t arena_this_slot()
+{
+    static thread_local arena_thread thread;
+    if (!thread.slot)
+        thread.slot = g_arena_next_slot.fetch_add(1, memory_order_relaxed) % arena_slot_number + 1;
+    return thread.slot - 1;
+}
+
+// 块内存（块头之后）
+static void* arena_payload(arena_block* block)
+{
+    return reinterpret_cast<char*>(block) + task_arena::alignment;
+}
+static arena_block* arena_header(void* ptr)
+{
+    return reinterpret_cast<arena_block*>(static_cast<char*>(ptr) - task_arena::alignment);
+}
+
+// 取出其他线程归还的块，按大小分类放入空闲链表，须在缓存槽锁内调用
+static void arena_reclaim(arena_slot& slot)
+{
+    auto block = slot.remote.exchange(nullptr, memory_order_acquire);
+    while (block)
+    {
+        auto next = block->next;
+        block->next = slot.free_list[block->size_class];
+        slot.free_list[block->size_class] = block;
+        block = next;
+    }
+}
+
+// 分配一个新的缓存块并切分为size_class类的空闲块，须在缓存槽锁内调用
+static void arena_refill(arena_slot& slot, size_t index, uint32_t size_class)
+{
+    auto size = arena_class_size[size_class];
+    auto slab = static_cast<char*>(::operator new(arena_slab_size));
+    slot.slab_allocations.fetch_add(1, memory_order_relaxed);
+    for (size_t offset = 0; offset + size <= arena_slab_size; offset += size)
+    {
+        auto block = reinterpret_cast<arena_block*>(slab + offset);
+        block->slot = (uint32_t)index;
+        block->size_class = size_class;
+        block->next = slot.free_list[size_class];
+        slot.free_list[size_class] = block;
+    }
+}
+
+void* task_arena::allocate(size_t size)
+{
+    auto index = arena_this_slot();
+    auto& slot = g_arena_slots[index];
+    uint32_t size_class = 0;
+    while (size_class < arena_class_number && size + alignment > arena_class_size[size_class])
+        size_class++;
+    if (size_class == arena_class_number || !g_arena_enabled.load(memory_order_relaxed))
+    { // 未启用缓存槽或大块直接向系统申请
+        auto block = static_cast<arena_block*>(::operator new(size + alignment));
+        block->slot = (uint32_t)index;
+        block->size_class = arena_large_class;
+        slot.large_allocations.fetch_add(1, memory_order_relaxed);
+        slot.allocations.fetch_add(1, memory_order_relaxed);
+        return arena_payload(block);
+    }
+    lock_guard<spin_mutex> lck(slot.lock);
+    if (!slot.free_list[size_class])
+        arena_reclaim(slot);
+    if (!slot.free_list[size_class])
+        arena_refill(slot, index, size_class);
+    auto block = slot.free_list[size_class];
+    slot.free_list[size_class] = block->next;
+    slot.allocations.fetch_add(1, memory_order_relaxed);
+    return arena_payload(block);
+}
+
+void task_arena::deallocate(void* ptr)
+{
+    if (!ptr)
+        return;
+    auto block = arena_header(ptr);
+    auto index = arena_this_slot();
+    auto& slot = g_arena_slots[index];
+    slot.deallocations.fetch_add(1, memory_order_relaxed);
+    if (block->size_class == arena_large_class)
+    {
+        ::operator delete(block);
+        return;
+    }
+    lock_guard<spin_mutex> lck(slot.lock);
+    auto owner = block->slot;
+    if (owner == index)
+    {
+        block->next = slot.free_list[block->size_class];
+        slot.free_list[block->size_class] = block;
+        return;
+    }
+    // 其他缓存槽的块先保存，满一批后一次归还给所属缓存槽
+    slot.remote_frees.fetch_add(1, memory_order_relaxed);
+    block->next = slot.pending_head[owner];
+    if (!slot.pending_head[owner])
+        slot.pending_tail[owner] = block;
+    slot.pending_head[owner] = block;
+    if (++slot.pending_count[owner] >= arena_remote_batch)
+        arena_flush(slot, owner);
+}
+
+arena_statistics task_arena::get_statistics()
+{
+    arena_statistics result = {};
+    for (auto& slot : g_arena_slots)
+    {
+        result.allocations += slot.allocations.load(memory_order_relaxed);
+        result.deallocations += slot.deallocations.load(memory_order_relaxed);
+        result.remote_frees += slot.remote_frees.load(memory_order_relaxed);
+        result.remote_batches += slot.remote_batches.load(memory_order_relaxed);
+        result.slab_allocations += slot.slab_allocations.load(memory_order_relaxed);
+        result.large_allocations += slot.large_allocations.load(memory_order_relaxed);
+    }
+    result.reserved_bytes = result.slab_allocations * arena_slab_size;
+    return result;
+}
+
+void task_arena::set_enabled(bool enabled)
+{
+    g_arena_enabled.store(enabled, memory_order_relaxed);
+}
+
+bool task_arena::is_enabled()
+{
+    return g_arena_enabled.load(memory_order_relaxed);
+}
+
+// 逻辑CPU的拓扑信息
+struct cpu_topology
+{
+    unsigned cpu;   // 逻辑CPU序号
+    unsigned core;  // 物理核心标识（包含处理器封装）
+    unsigned node;  // NUMA节点序号
+};
+
+// 工作线程的CPU集合和内存节点
+struct cpu_placement
+{
+    vector<unsigned> cpus;
+    int node; // 内存优先分配的NUMA节点，-1为默认策略
+};
+
+// 获取进程可用的逻辑CPU的拓扑信息，按逻辑CPU序号排列
+static vector<cpu_topology> get_cpu_topology()
+{
+    vector<cpu_topology> result;
+#if defined(_WIN32) || defined(WIN32)
+    // 只支持当前处理器组（最多64个逻辑CPU）
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        return result;
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (info.empty() || !GetLogicalProcessorInformation(info.data(), &length))
+        return result;
+    for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; cpu++)
+    {
+        auto mask = (DWORD_PTR)1 << cpu;
+        if (!(process_mask & mask))
+            continue;
+        cpu_topology val = { cpu, cpu, 0 };
+        unsigned core = 0;
+        for (auto& item : info)
+        {
+            if (item.Relationship == RelationProcessorCore)
+            {
+                if (item.ProcessorMask & mask)
+                    val.core = core;
+                core++;
+            }
+            else if (item.Relationship == RelationNumaNode && (item.ProcessorMask & mask))
+                val.node = item.NumaNode.NodeNumber;
+        }
+        result.push_back(val);
+    }
+#else // UNIX
+    cpu_set_t process_set;
+    CPU_ZERO(&process_set);
+    if (sched_getaffinity(getpid(), sizeof(process_set), &process_set))
+        return result;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &process_set))
+            continue;
+        cpu_topology val = { cpu, cpu, 0 };
+        char path[128];
+        unsigned package = 0, core = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+        ifstream package_file(path);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+        ifstream core_file(path);
+        if (package_file >> package && core_file >> core)
+            val.core = package << 16 | core;
+        // NUMA节点为CPU目录中的nodeN链接
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+        if (auto dir = opendir(path))
+        {
+            while (auto entry = readdir(dir))
+                if (!strncmp(entry->d_name, "node", 4) && isdigit((unsigned char)entry->d_name[4]))
+                    val.node = (unsigned)atoi(entry->d_name + 4);
+            closedir(dir);
+        }
+        result.push_back(val);
+    }
+#endif // #if defined(_WIN32) || defined(WIN32)
+    return result;
+}
+
+// 按线程亲和性计算每个工作线程的CPU集合和内存节点，获取CPU拓扑失败时返回空
+static vector<cpu_placement> get_cpu_placements(thread_affinity affinity, const vector<unsigned>& cpus, size_t thread_number)
+{
+    vector<cpu_placement> result;
+    auto&& topology = get_cpu_topology();
+    if (affinity != thread_affinity::none && !cpus.empty())
+        topology.erase(remove_if(topology.begin(), topology.end(), [&](const cpu_topology& val){
+            return find(cpus.begin(), cpus.end(), val.cpu) == cpus.end(); }), topology.end());
+    if (topology.empty())
+        return result;
+    switch (affinity)
+    {
+    case thread_affinity::none:
+    case thread_affinity::cpu_set:
+    {
+        cpu_placement placement = { vector<unsigned>(), -1 };
+        for (auto& val : topology)
+            placement.cpus.push_back(val.cpu);
+        result.assign(thread_number, placement);
+        break;
+    }
+    case thread_affinity::per_cpu:
+        for (size_t i = 0; i < thread_number; i++)
         {
-            return run(pause_event, resume_event);
+            cpu_placement placement = { vector<unsigned>(1, topology[i % topology.size()].cpu), -1 };
+            result.push_back(move(placement));
         }
-        catch (function<void()>& function_object)
+        break;
+    case thread_affinity::spread_cores:
+    {
+        // 每个物理核心取第一个逻辑CPU，按节点内的核心序号交替排列各节点的核心
+        vector<pair<size_t, cpu_topology>> cores;
+        for (auto& val : topology)
         {
-            debug_output<true>(_T(__FILE__), _T('('), __LINE__, _T("): "), function_object.target_type().name());
-            m_exception_tasks.push_back(move(function_object));
-            m_task_exception++;
+            if (any_of(cores.begin(), cores.end(), [&](const pair<size_t, cpu_topology>& core){ return core.second.core == val.core; }))
+                continue;
+            auto rank = (size_t)count_if(cores.begin(), cores.end(), [&](const pair<size_t, cpu_topology>& core){ return core.second.node == val.node; });
+            cores.push_back(make_pair(rank, val));
         }
+        stable_sort(cores.begin(), cores.end(), [](const pair<size_t, cpu_topology>& a, const pair<size_t, cpu_topology>& b){
+            return a.first < b.first || (a.first == b.first && a.second.node < b.second.node); });
+        for (size_t i = 0; i < thread_number; i++)
+        {
+            cpu_placement placement = { vector<unsigned>(1, cores[i % cores.size()].second.cpu), -1 };
+            result.push_back(move(placement));
+        }
+        break;
     }
+    case thread_affinity::spread_numa:
+    {
+        vector<unsigned> nodes;
+        for (auto& val : topology)
+            if (find(nodes.begin(), nodes.end(), val.node) == nodes.end())
+                nodes.push_back(val.node);
+        sort(nodes.begin(), nodes.end());
+        for (size_t i = 0; i < thread_number; i++)
+        {
+            auto node = nodes[i % nodes.size()];
+            cpu_placement placement = { vector<unsigned>(), (int)node };
+            for (auto& val : topology)
+                if (val.node == node)
+                    placement.cpus.push_back(val.cpu);
+            result.push_back(move(placement));
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return result;
 }
 
-// 线程运行前准备，不捕获异常
-template<> inline size_t threadpool<false>::pre_run(HANDLE pause_event, HANDLE resume_event)
+// 设置线程可以运行的CPU集合
+static bool set_native_thread_affinity(thread::native_handle_type handle, const vector<unsigned>& cpus)
 {
-    return run(pause_event, resume_event);
+#if defined(_WIN32) || defined(WIN32)
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus)
+        if (cpu < sizeof(DWORD_PTR) * 8)
+            mask |= (DWORD_PTR)1 << cpu;
+    return mask && SetThreadAffinityMask((HANDLE)handle, mask);
+#else // UNIX
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpu_set);
+    return !pthread_setaffinity_np(handle, sizeof(cpu_set), &cpu_set);
+#endif // #if defined(_WIN32) || defined(WIN32)
 }
 
+// 当前线程的内存优先从NUMA节点分配，node为-1时恢复默认策略
+static void bind_memory_node(int node)
+{
+#if defined(_WIN32) || defined(WIN32)
+    // Windows没有线程级内存策略，线程固定在节点的CPU上时首次访问的页面从本节点分配
+    (void)node;
+#elif defined(SYS_set_mempolicy) // Linux，不依赖libnuma直接调用set_mempolicy
+    const int mpol_default = 0, mpol_preferred = 1;
+    unsigned long node_mask[16] = {};
+    const int node_bits = sizeof(node_mask) * 8;
+    if (node < 0 || node >= node_bits)
+        syscall(SYS_set_mempolicy, mpol_default, nullptr, 0);
+    else
+    {
+        node_mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+        syscall(SYS_set_mempolicy, mpol_preferred, node_mask, node_bits + 1);
+    }
+#else // UNIX
+    (void)node;
+#endif // #if defined(_WIN32) || defined(WIN32)
+}
+
+// 创建线程预算，第一个线程池加入时启动仲裁线程
+worker_budget::worker_budget(const budget_config& config) : m_config(config)
+{
+    if (m_config.interval.count() <= 0)
+        m_config.interval = chrono::milliseconds(100);
+}
 
-// 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]，捕获异常
-template<> inline bool threadpool<true>::run_task(pair<function<void()>, size_t>&& task_val)
+// 停止仲裁线程，所有线程池退出预算并保持当前线程数
+worker_budget::~worker_budget()
 {
-    // 任务队列中有任务未处理，发送线程启动通知
-    if (task_val.second > 1)
-        notify();
-    if (task_val.second)
+    unique_lock<mutex> lck(m_lock);
+    m_stop = true;
+    m_cv.notify_all();
+    if (m_thread.joinable())
     {
-        try
+        lck.unlock();
+        m_thread.join();
+        lck.lock();
+    }
+    for (auto& entry : m_members)
+        entry.unbind(entry.pool);
+    m_members.clear();
+}
+
+void worker_budget::add_member(const member& entry)
+{
+    lock_guard<mutex> lck(m_lock);
+    m_members.push_back(entry);
+    if (!m_thread.joinable())
+        m_thread = thread([this]{ run(); });
+    // 加入时立即分配，线程池原有的线程数不超出预算
+    sample_members();
+    allocate();
+}
+
+bool worker_budget::remove_member(const void* pool)
+{
+    lock_guard<mutex> lck(m_lock);
+    auto iter = find_if(m_members.begin(), m_members.end(), [pool](const member& entry){ return entry.pool == pool; });
+    if (iter == m_members.end())
+        return false;
+    iter->unbind(iter->pool);
+    m_members.erase(iter);
+    return true;
+}
+
+void worker_budget::set_total_threads(int total_threads)
+{
+    lock_guard<mutex> lck(m_lock);
+    m_config.total_threads = auto_max(total_threads, 0);
+}
+
+int worker_budget::get_total_threads() const
+{
+    lock_guard<mutex> lck(m_lock);
+    return m_config.total_threads ? m_config.total_threads : auto_max((int)thread::hardware_concurrency(), 1);
+}
+
+void worker_budget::rebalance()
+{
+    lock_guard<mutex> lck(m_lock);
+    sample_members();
+    allocate();
+}
+
+vector<budget_allocation> worker_budget::get_allocations() const
+{
+    lock_guard<mutex> lck(m_lock);
+    vector<budget_allocation> result;
+    result.reserve(m_members.size());
+    for (auto& entry : m_members)
+        result.push_back(entry.allocation);
+    return result;
+}
+
+void worker_budget::run()
+{
+    unique_lock<mutex> lck(m_lock);
+    auto last_time = chrono::steady_clock::now();
+    while (true)
+    {
+        auto sample_interval = auto_max(m_config.interval / 8, chrono::milliseconds(1));
+        if (m_cv.wait_for(lck, sample_interval, [this]{ return m_stop; }))
+            break;
+        sample_members();
+        auto now = chrono::steady_clock::now();
+        if (now - last_time < m_config.interval)
+            continue;
+        last_time = now;
+        allocate();
+    }
+}
+
+void worker_budget::sample_members()
+{
+    for (auto& entry : m_members)
+    {
+        member_sample sample;
+        entry.sample(entry.pool, sample);
+        entry.peak_demand = auto_max(entry.peak_demand, sample.running + sample.queue_depth);
+    }
+}
+
+/* 分配线程数：每个线程池先得到需要的线程数和按权重保证的线程数中较小的一个，
+*  剩余的线程每次一个分给需要更多线程、已分配线程数与权重之比最小的线程池（借入），
+*  线程池需要的线程数增加时按保证的线程数收回借出的线程
+**/
+void worker_budget::allocate()
+{
+    int total = m_config.total_threads ? m_config.total_threads : auto_max((int)thread::hardware_concurrency(), 1);
+    vector<member_sample> samples(m_members.size());
+    double weight_sum = 0;
+    for (size_t i = 0; i < m_members.size(); i++)
+    {
+        auto& entry = m_members[i];
+        entry.sample(entry.pool, samples[i]);
+        entry.allocation.active = samples[i].active;
+        if (samples[i].active)
+            weight_sum += entry.share.weight;
+    }
+    int used = 0;
+    for (size_t i = 0; i < m_members.size(); i++)
+    {
+        auto& entry = m_members[i];
+        auto& allocation = entry.allocation;
+        auto peak_demand = auto_max(entry.peak_demand, samples[i].running + samples[i].queue_depth);
+        entry.peak_demand = 0;
+        if (!allocation.active) // 暂停、退出流程中保持线程数不变
         {
-            task_val.first();
+            allocation.thread_number = samples[i].thread_number;
+            entry.shrink_count = 0;
+            continue;
         }
-        catch (exception& e)
+        int max_threads = entry.share.max_threads ? auto_min(entry.share.max_threads, total) : total;
+        int min_threads = auto_min(entry.share.min_threads, max_threads);
+        allocation.demand = (int)auto_min(auto_max(peak_demand, (size_t)min_threads), (size_t)max_threads);
+        allocation.guaranteed = auto_min(auto_max((int)(total * entry.share.weight / weight_sum), min_threads), max_threads);
+        allocation.thread_number = auto_min(allocation.demand, allocation.guaranteed);
+        used += allocation.thread_number;
+    }
+    while (used < total)
+    {
+        member* borrower = nullptr;
+        double borrower_ratio = 0;
+        for (auto& entry : m_members)
         {
-            debug_output<true>(_T(__FILE__), _T('('), __LINE__, _T("): "), e.what(), " | ", task_val.first.target_type().name());
-            throw move(task_val.first);
-            return false;
+            auto& allocation = entry.allocation;
+            if (!allocation.active || allocation.thread_number >= allocation.demand)
+                continue;
+            double ratio = (allocation.thread_number + 1) / entry.share.weight;
+            if (!borrower || ratio < borrower_ratio)
+            {
+                borrower = &entry;
+                borrower_ratio = ratio;
+            }
         }
-        catch (...)
+        if (!borrower)
+            break;
+        borrower->allocation.thread_number++;
+        used++;
+    }
+    // 减少线程数须连续满足shrink_hold个间隔，避免线程数来回振荡; 保留的线程超出总数时立即收回
+    vector<int> targets(m_members.size());
+    int kept = 0;
+    for (size_t i = 0; i < m_members.size(); i++)
+    {
+        auto& entry = m_members[i];
+        if (!entry.allocation.active)
+            continue;
+        if (entry.allocation.thread_number >= samples[i].thread_number)
         {
-            throw move(task_val.first);
-            return false;
+            entry.shrink_count = 0;
+            targets[i] = entry.allocation.thread_number;
         }
-        m_task_completed++;
+        else
+            targets[i] = ++entry.shrink_count >= m_config.shrink_hold ? entry.allocation.thread_number : samples[i].thread_number;
+        kept += targets[i];
     }
-    return task_val.second > 1;
+    for (size_t i = 0; i < m_members.size(); i++)
+    {
+        auto& entry = m_members[i];
+        if (!entry.allocation.active)
+            continue;
+        if (kept > total && targets[i] > entry.allocation.thread_number)
+            targets[i] = entry.allocation.thread_number;
+        entry.allocation.thread_number = targets[i];
+        if (targets[i] < samples[i].thread_number)
+            entry.shrink_count = 0;
+    }
+    // 先减少再增加线程数，调整过程中线程总数不超过预算
+    for (size_t i = 0; i < m_members.size(); i++)
+        if (m_members[i].allocation.active && targets[i] < samples[i].thread_number)
+            m_members[i].resize(m_members[i].pool, targets[i]);
+    for (size_t i = 0; i < m_members.size(); i++)
+        if (m_members[i].allocation.active && targets[i] > samples[i].thread_number)
+            m_members[i].resize(m_members[i].pool, targets[i]);
 }
 
-// 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]，不捕获异常
-template<> inline bool threadpool<false>::run_task(pair<function<void()>, size_t>&& task_val)
+// 共享分离任务的完成状态：分离的线程和每个任务各持有一个计数，最后释放的设置分离结果
+struct detach_state
 {
-    // 任务队列中有任务未处理，发送线程启动通知
-    if (task_val.second > 1)
-        notify();
-    if (task_val.second)
+    atomic<size_t> remaining;
+    size_t value;
+    promise<size_t> result;
+    // threadpool<true>分离的任务抛出异常时记录在本次分离的failures中，不记录到后台线程池; failures为空时丢弃
+    bool handle_exception;
+    shared_ptr<deque<task_failure>> failures;
+    spin_mutex failure_lock;
+    // 分离的任务，后台线程池中的detached_task按序号运行，添加后不再改变容器结构
+    deque<task_object> tasks;
+
+    detach_state(size_t value_arg, bool handle_exception_arg, shared_ptr<deque<task_failure>> failures_arg) :
+        remaining(1), value(value_arg), handle_exception(handle_exception_arg), failures(move(failures_arg)){}
+    void record_failure(task_object&& task, exception_ptr exception)
     {
-        task_val.first();
-        m_task_completed++;
+        if (!failures)
+            return;
+        lock_guard<spin_mutex> lck(failure_lock);
+        failures->emplace_back(move(task), move(exception), 1);
     }
-    return task_val.second > 1;
-}
+    void release()
+    {
+        if (remaining.fetch_sub(1, memory_order_acq_rel) == 1)
+        {
+            result.set_value(value);
+            delete this;
+        }
+    }
+};
+
+/* 共享分离任务的后台线程池，所有类型的线程池共用，在所有线程池的实现之后定义;
+*  分离的任务自己记录异常（threadpool<true>）或者传出异常（threadpool<false>），后台线程池为threadpool<false>
+**/
+static threadpool<false>& shared_background_pool();
 
+/* 共享分离的任务：只保存分离状态和任务序号（直接保存在任务对象内部，不额外分配），
+*  运行结束（包括抛出异常）或者未运行就被销毁时销毁分离状态中的任务并释放计数
+**/
+class detached_task : public cancellable_tag
+{
+private:
+    detach_state* m_state;
+    size_t m_index;
+
+    void complete()
+    {
+        auto state = m_state;
+        m_state = nullptr;
+        if (state)
+        {
+            state->tasks[m_index] = task_object();
+            state->release();
+        }
+    }
 
+public:
+    detached_task(detach_state* state, size_t index) noexcept : m_state(state), m_index(index){}
+    detached_task(detached_task&& other) noexcept : m_state(other.m_state), m_index(other.m_index)
+    {
+        other.m_state = nullptr;
+    }
+    detached_task(const detached_task&) = delete;
+    detached_task& operator=(const detached_task&) = delete;
+    ~detached_task()
+    {
+        complete();
+    }
+    bool is_cancelled() const
+    {
+        return m_state && m_state->tasks[m_index].is_cancelled();
+    }
+    void operator()()
+    {
+        struct complete_guard
+        {
+            detached_task* task;
+            ~complete_guard()
+            {
+                task->complete();
+            }
+        } guard = { this };
+        auto& task = m_state->tasks[m_index];
+        if (!m_state->handle_exception)
+        {
+            task();
+            return;
+        }
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            m_state->record_failure(move(task), current_exception());
+        }
+    }
+};
+
+// 生成宏：每种任务队列锁类型生成处理异常和不处理异常的线程池
+#define TASK_LOCK spin_mutex
 #define HANDLE_EXCEPTION true
 #include "xxthreadpool.h"
 #undef HANDLE_EXCEPTION
+#define HANDLE_EXCEPTION false
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#undef TASK_LOCK
 
+#define TASK_LOCK ttas_mutex
+#define HANDLE_EXCEPTION true
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
 #define HANDLE_EXCEPTION false
 #include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#undef TASK_LOCK
+
+#define TASK_LOCK ticket_mutex
+#define HANDLE_EXCEPTION true
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#define HANDLE_EXCEPTION false
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#undef TASK_LOCK
+
+#define TASK_LOCK mcs_mutex
+#define HANDLE_EXCEPTION true
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#define HANDLE_EXCEPTION false
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#undef TASK_LOCK
+
+#define TASK_LOCK adaptive_mutex
+#define HANDLE_EXCEPTION true
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#define HANDLE_EXCEPTION false
+#include "xxthreadpool.h"
+#undef HANDLE_EXCEPTION
+#undef TASK_LOCK
+
+// 获取后台线程池，第一次使用时按逻辑CPU数创建线程; 有意不释放，进程退出时不析构（Windows下在DLL加载器锁内）、不等待后台线程
+static threadpool<false>& shared_background_pool()
+{
+    static auto pool = new threadpool<false>(max(1, (int)thread::hardware_concurrency()));
+    return *pool;
+}
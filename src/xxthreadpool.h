@@ -1,15 +1,116 @@
 ﻿/**********************************************************
 * 线程池控制类
-* 支持平台：Windows
-* 编译环境：VS2013+
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
 ***********************************************************/
 
-template<> threadpool<HANDLE_EXCEPTION>::~threadpool()
+// 显式特化须在首次使用前声明
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_thread_number(int thread_number);
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_new_thread_number(int thread_number_new);
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_thread_priority(thread_priority priority);
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::apply_thread_affinity();
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::stop_autoscale();
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::autoscale_run();
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::stop_timer();
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::timer_run();
+template<> size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::drop_oldest_tasks(size_t count);
+template<> inline size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::run(HANDLE pause_event, HANDLE resume_event);
+
+// 线程运行前准备，任务的异常在run_task中记录，不传出
+template<> inline size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::pre_run(HANDLE pause_event, HANDLE resume_event)
+{
+    return run(pause_event, resume_event);
+}
+
+#if HANDLE_EXCEPTION
+// 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]，捕获异常并按重试策略重试或者记录
+template<> inline bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::run_task(pair<task_object, size_t>&& task_val)
+{
+    // 任务队列中有任务未处理时，get_task已发送线程启动通知
+    if (task_val.second && task_val.first.is_cancelled())
+    { // 已取消的任务不运行
+        m_task_started++;
+        m_task_cancelled++;
+        notify_capacity();
+    }
+    else if (task_val.second)
+    {
+        m_task_started++;
+        notify_capacity(); // 任务取出后容量可能空出
+#ifdef THREADPOOL_HISTOGRAM
+        auto start_time = histogram_clock();
+#endif
+        for (size_t attempts = 1;; attempts++)
+        {
+            exception_ptr error;
+            try
+            {
+                task_val.first();
+                break;
+            }
+            catch (exception& e)
+            {
+                debug_output<true>(_T(__FILE__), _T('('), __LINE__, _T("): "), e.what(), " | ", task_val.first.target_type().name());
+                error = current_exception();
+            }
+            catch (...)
+            {
+                debug_output<true>(_T(__FILE__), _T('('), __LINE__, _T("): "), task_val.first.target_type().name());
+                error = current_exception();
+            }
+            if (!retry_task(task_val.first, error, attempts))
+            { // 异常和任务一起记录，不再抛出
+                push_exception_task(move(task_val.first), move(error), attempts);
+                return task_val.second > 1;
+            }
+        }
+#ifdef THREADPOOL_HISTOGRAM
+        record_task(task_val.first, start_time);
+#endif
+        m_task_completed++;
+    }
+    return task_val.second > 1;
+}
+#else  /* HANDLE_EXCEPTION */
+// 运行一条任务，返回任务队列中是否还有任务[true:有任务; false:没任务]，不捕获异常
+template<> inline bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::run_task(pair<task_object, size_t>&& task_val)
+{
+    // 任务队列中有任务未处理时，get_task已发送线程启动通知
+    if (task_val.second && task_val.first.is_cancelled())
+    { // 已取消的任务不运行
+        m_task_started++;
+        m_task_cancelled++;
+        notify_capacity();
+    }
+    else if (task_val.second)
+    {
+        m_task_started++;
+        notify_capacity(); // 任务取出后容量可能空出
+#ifdef THREADPOOL_HISTOGRAM
+        auto start_time = histogram_clock();
+        task_val.first();
+        record_task(task_val.first, start_time);
+#else
+        task_val.first();
+#endif
+        m_task_completed++;
+    }
+    return task_val.second > 1;
+}
+#endif  /* HANDLE_EXCEPTION */
+
+template<> threadpool<HANDLE_EXCEPTION, TASK_LOCK>::~threadpool()
 {
+    m_scheduler_handle->reset(); // 之后pool_future的延续任务在当前线程直接运行，不再访问线程池
+    auto budget = m_budget.load();
+    if (budget) // 退出线程预算，仲裁线程不再调整线程数
+        budget->remove_member(this);
+    stop_timer(); // 先停止定时器，未到期的定时任务丢弃
+    stop_autoscale(); // 停止自动调整线程数
     stop_on_completed(); // 退出时等待任务清空
     for (auto& handle_obj : m_thread_object)
     {
-#if _MSC_VER <= 1800 // Fix std::thread deadlock bug on VS2012,VS2013 (when call join on exit)
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // Fix std::thread deadlock bug on VS2012,VS2013 (when call join on exit)
         WaitForSingleObject((HANDLE)get<0>(handle_obj).native_handle(), INFINITE);
         get<0>(handle_obj).detach();
 #else // Other platform
@@ -18,18 +119,61 @@ template<> threadpool<HANDLE_EXCEPTION>::~threadpool()
     }
     for (auto& handle_obj : m_thread_destroy)
     {
-#if _MSC_VER <= 1800 // Fix std::thread deadlock bug on VS2012,VS2013 (when call join on exit)
+#if defined(_MSC_VER) && _MSC_VER <= 1800 // Fix std::thread deadlock bug on VS2012,VS2013 (when call join on exit)
         WaitForSingleObject((HANDLE)get<0>(handle_obj).native_handle(), INFINITE);
         get<0>(handle_obj).detach();
 #else // Other platform
         get<0>(handle_obj).join(); // 等待所有已销毁分离的线程退出
 #endif // #if _MSC_VER <= 1800
     }
+    clear(); // 在对象销毁前销毁未执行的任务，pool_future设置为broken_promise
+    get_task_failures(); // 销毁异常任务记录
+}
+
+// 当前线程的工作线程上下文
+template<> threadpool<HANDLE_EXCEPTION, TASK_LOCK>::worker_context*& threadpool<HANDLE_EXCEPTION, TASK_LOCK>::this_worker()
+{
+    static thread_local worker_context* worker = nullptr;
+    return worker;
+}
+
+// 线程池的线程等待时运行一条任务
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::help_run(void* pool)
+{
+    auto object = (threadpool*)pool;
+    // 暂停或退出时不帮助运行，和工作线程相同
+    switch (object->m_exit_event.load())
+    {
+    case exit_event_t::NORMAL:
+    case exit_event_t::WAIT_TASK_COMPLETE:
+        break;
+    default:
+        return false;
+    }
+    auto task_val = object->get_help_task();
+    if (!task_val.second)
+        return false;
+    // threadpool<true>时异常和工作线程相同地记录，不传递给等待的任务
+    object->run_task(move(task_val));
+    return true;
+}
+
+// 设置当前线程的帮助运行上下文
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_help_context(threadpool* object)
+{
+    auto& context = this_help_context();
+    context.run_one = &help_run;
+    context.pool = object;
+    context.depth = 0;
 }
 
 // 线程入口函数
-template<> size_t threadpool<HANDLE_EXCEPTION>::thread_entry(threadpool* object, HANDLE pause_event, HANDLE resume_event)
+template<> size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::thread_entry(threadpool* object, HANDLE pause_event, HANDLE resume_event, worker_context* worker)
 {
+    this_worker() = worker;
+    if (worker) // 工作线程按序号使用不同的计数器分片
+        sharded_counter::set_this_shard(worker->index);
+    set_help_context(object);
     debug_output(_T("Thread Start: ["), this_type().name(), _T("](0x"), object, _T(')'));
     size_t result = object->pre_run(pause_event, resume_event);
     debug_output(_T("Thread Result: ["), (void*)result, _T("] ["), this_type().name(), _T("](0x"), object, _T(')'));
@@ -37,26 +181,32 @@ template<> size_t threadpool<HANDLE_EXCEPTION>::thread_entry(threadpool* object,
 }
 
 // 线程入口函数，线程启动时先执行一次启动函数
-template<> size_t threadpool<HANDLE_EXCEPTION>::thread_entry_startup(threadpool* object, HANDLE pause_event, HANDLE resume_event, function<void()>& startup_fn)
+template<> size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::thread_entry_startup(threadpool* object, HANDLE pause_event, HANDLE resume_event, worker_context* worker, function<void()> startup_fn)
 {
+    this_worker() = worker;
+    if (worker) // 工作线程按序号使用不同的计数器分片
+        sharded_counter::set_this_shard(worker->index);
+    set_help_context(object);
     debug_output(_T("Startup Thread Start: ["), this_type().name(), _T("](0x"), object, _T(')'));
-    object->run_task(make_pair(move(startup_fn), 1));
-    object->m_task_all++;
+    object->run_task(make_pair(task_object(move(startup_fn)), 1));
+    object->m_task_all++; // 启动函数计入已添加、已开始和已完成的任务数
     size_t result = object->pre_run(pause_event, resume_event);
     debug_output(_T("Startup Thread Result: ["), (void*)result, _T("] ["), this_type().name(), _T("](0x"), object, _T(')'));
     return result;
 }
 
 // 任务运行主体函数
-template<> inline size_t threadpool<HANDLE_EXCEPTION>::run(HANDLE pause_event, HANDLE resume_event)
+template<> inline size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::run(HANDLE pause_event, HANDLE resume_event)
 {
     // 线程通知事件
     HANDLE handle_notify[] = { pause_event, m_stop_thread, m_notify_task };
     HANDLE handle_resume[] = { resume_event, m_stop_thread };
+    // 当前线程的工作线程上下文
+    auto worker = this_worker();
     while (true)
     {
-        // 监听线程通知事件
-        switch (WaitForMultipleObjects(sizeof(handle_notify) / sizeof(HANDLE), handle_notify, FALSE, INFINITE))
+        // 监听线程通知事件，按空闲策略等待
+        switch (wait_notify(handle_notify, sizeof(handle_notify) / sizeof(HANDLE)))
         {
         case WAIT_OBJECT_0:         // 挂起当前线程
             switch (WaitForMultipleObjects(sizeof(handle_resume) / sizeof(HANDLE), handle_resume, FALSE, INFINITE))
@@ -89,6 +239,9 @@ template<> inline size_t threadpool<HANDLE_EXCEPTION>::run(HANDLE pause_event, H
         case WAIT_OBJECT_0 + 2:     // 当前线程激活
             while (true)
             {
+                // 内存节点改变后在运行任务前应用
+                if (worker && worker->memory_node.load(memory_order_relaxed) != worker->applied_memory_node)
+                    bind_memory_node(worker->applied_memory_node = worker->memory_node.load(memory_order_relaxed));
                 if (!run_task(get_task())) // 任务队列中没有任务
                 {
                     if (m_exit_event == exit_event_t::WAIT_TASK_COMPLETE)
@@ -107,16 +260,24 @@ template<> inline size_t threadpool<HANDLE_EXCEPTION>::run(HANDLE pause_event, H
 
 
 // 分离任务
-template<> void threadpool<HANDLE_EXCEPTION>::detach(int thread_number_new)
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::detach(int thread_number_new)
 {
     auto detach_threadpool = new threadpool(thread_number_new);
     unique_lock<decltype(m_task_lock)> lck(m_task_lock); // 当前线程池任务队列读写锁
     unique_lock<decltype(m_task_lock)> lck_new(detach_threadpool->m_task_lock); // 新线程池任务队列读写锁
+    drain_local_tasks(*m_push_tasks); // 工作线程本地任务一并分离
+    drain_batch_tasks(*m_push_tasks); // 已取出到工作线程、尚未运行的批量任务一并分离
+    take_priority_tasks(*m_push_tasks); // 高、低优先级任务按优先级顺序分离
     swap(*m_push_tasks, detach_threadpool->m_tasks); // 交换任务队列
+    // 分离的任务从添加的任务总数中减去，计入分离的线程池
+    auto detach_number = detach_threadpool->m_tasks.size();
+    m_task_all -= detach_number;
+    detach_threadpool->m_task_all += detach_number;
     lck_new.unlock();
     lck.unlock();
+    notify_capacity();
     // 通知分离的线程对象运行
-    detach_threadpool->notify(detach_threadpool->m_tasks.size());
+    detach_threadpool->notify(detach_number);
     async([](decltype(detach_threadpool) pClass){
         delete pClass;
         static const size_t result = success_code + 0xff;
@@ -126,17 +287,25 @@ template<> void threadpool<HANDLE_EXCEPTION>::detach(int thread_number_new)
 }
 
 // 分离任务，并得到分离任务执行情况的future
-template<> future<size_t> threadpool<HANDLE_EXCEPTION>::detach_future(int thread_number_new)
+template<> future<size_t> threadpool<HANDLE_EXCEPTION, TASK_LOCK>::detach_future(int thread_number_new)
 {
     future<size_t> future_obj;
     auto detach_threadpool = new threadpool(thread_number_new);
     unique_lock<decltype(m_task_lock)> lck(m_task_lock); // 当前线程池任务队列读写锁
     unique_lock<decltype(m_task_lock)> lck_new(detach_threadpool->m_task_lock); // 新线程池任务队列读写锁
+    drain_local_tasks(*m_push_tasks); // 工作线程本地任务一并分离
+    drain_batch_tasks(*m_push_tasks); // 已取出到工作线程、尚未运行的批量任务一并分离
+    take_priority_tasks(*m_push_tasks); // 高、低优先级任务按优先级顺序分离
     swap(*m_push_tasks, detach_threadpool->m_tasks); // 交换任务队列
+    // 分离的任务从添加的任务总数中减去，计入分离的线程池
+    auto detach_number = detach_threadpool->m_tasks.size();
+    m_task_all -= detach_number;
+    detach_threadpool->m_task_all += detach_number;
     lck_new.unlock();
     lck.unlock();
+    notify_capacity();
     // 通知分离的线程对象运行
-    detach_threadpool->notify(detach_threadpool->m_tasks.size());
+    detach_threadpool->notify(detach_number);
     // 绑定函数
     auto task_obj = make_shared<packaged_task<size_t()>>(bind([](decltype(detach_threadpool) pClass){
         delete pClass;
@@ -150,10 +319,46 @@ template<> future<size_t> threadpool<HANDLE_EXCEPTION>::detach_future(int thread
     return move(future_obj);;
 }
 
+// 分离任务到后台线程池，并得到分离任务全部完成的future; 抛出异常的任务记录到本次分离的failures
+template<> future<size_t> threadpool<HANDLE_EXCEPTION, TASK_LOCK>::detach_shared(shared_ptr<deque<task_failure>> failures)
+{
+    decltype(m_tasks) tasks;
+    {
+        lock_guard<decltype(m_task_lock)> lck(m_task_lock); // 任务队列读写锁
+        drain_local_tasks(*m_push_tasks); // 工作线程本地任务一并分离
+        drain_batch_tasks(*m_push_tasks); // 已取出到工作线程、尚未运行的批量任务一并分离
+        take_priority_tasks(*m_push_tasks); // 高、低优先级任务按优先级顺序分离
+        m_task_all -= m_push_tasks->size();
+        m_push_tasks->swap(tasks);
+    }
+    notify_capacity();
+    auto state = new detach_state(success_code + 0xff, HANDLE_EXCEPTION, move(failures));
+    auto future_obj = state->result.get_future();
+    try
+    { // 任务保存在分离状态中，每个detached_task持有一个计数，在后台线程池中运行或者被清理时释放
+        state->tasks.swap(tasks);
+        for (size_t i = 0; i < state->tasks.size(); i++)
+        {
+            state->remaining++;
+            tasks.emplace_back(detached_task(state, i));
+        }
+        shared_background_pool().push_tasks(move(tasks));
+    }
+    catch (...)
+    {
+        state->release();
+        throw;
+    }
+    state->release();
+    return future_obj;
+}
+
 // 销毁线程池。WARNING: 线程会被直接分离，可能会造成资源泄露!!!
-template<> void threadpool<HANDLE_EXCEPTION>::destroy()
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::destroy()
 {
-    // 停止线程池的运行
+    // 停止定时器、自动调整线程数和线程池的运行
+    stop_timer();
+    stop_autoscale();
     stop();
     // 线程创建、销毁事件锁
     unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
@@ -184,7 +389,7 @@ template<> void threadpool<HANDLE_EXCEPTION>::destroy()
 
 
 // 设置线程数
-template<> bool threadpool<HANDLE_EXCEPTION>::set_thread_number(int thread_number)
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_thread_number(int thread_number)
 {
     assert(thread_number >= 0 && thread_number < 255); // Thread number must greater than or equal 0 and less than 255
     switch (m_exit_event.load())
@@ -204,7 +409,7 @@ template<> bool threadpool<HANDLE_EXCEPTION>::set_thread_number(int thread_numbe
 }
 
 // 设置新的处理线程数，退出流程和未初始化的线程池则失败
-template<> bool threadpool<HANDLE_EXCEPTION>::set_new_thread_number(int thread_number_new)
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_new_thread_number(int thread_number_new)
 {
     assert(thread_number_new >= 0 && thread_number_new < 255); // Thread number must greater than or equal 0 and less than 255
     switch (m_exit_event.load())
@@ -225,7 +430,7 @@ template<> bool threadpool<HANDLE_EXCEPTION>::set_new_thread_number(int thread_n
         bool already_create_new_thread = false;
         // 线程创建、销毁事件锁
         unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
-        for (register int i = m_thread_started.load(); i < thread_number_new; i++)
+        for (int i = m_thread_started.load(); i < thread_number_new; i++)
         {
             if (m_thread_destroy.size())
             {
@@ -240,17 +445,19 @@ template<> bool threadpool<HANDLE_EXCEPTION>::set_new_thread_number(int thread_n
                 already_create_new_thread = true;
                 HANDLE thread_exit_event = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
                 HANDLE thread_resume_event = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
+                auto worker = create_worker();
                 m_thread_object.push_back(make_tuple(
-                    thread(thread_entry, this, thread_exit_event, thread_resume_event),
+                    thread(thread_entry, this, thread_exit_event, thread_resume_event, worker),
                     SAFE_HANDLE_OBJECT(thread_exit_event),
-                    SAFE_HANDLE_OBJECT(thread_resume_event)));
+                    SAFE_HANDLE_OBJECT(thread_resume_event),
+                    worker));
             }
             m_thread_started++;
         }
         // 只在创建新线程时设置优先级
         if (already_create_new_thread)
             set_thread_priority(m_priority);
-        for (register int i = m_thread_started.load(); i > thread_number_new; i--)
+        for (int i = m_thread_started.load(); i > thread_number_new; i--)
         {
             auto iter = m_thread_object.begin();
             ResetEvent(get<2>(*iter));  // 取消线程恢复事件
@@ -260,15 +467,17 @@ template<> bool threadpool<HANDLE_EXCEPTION>::set_new_thread_number(int thread_n
             m_thread_started--;
         }
         assert(m_thread_started.load() == thread_number_new);
+        // 线程数改变后重新分配亲和性，包括从已销毁分离的线程中恢复的线程
+        apply_thread_affinity();
         lck.unlock();
     }
     m_is_start = !!m_thread_started.load();
-    notify(m_tasks.size());
+    notify(get_tasks_number()); // 任务队列读写锁内获取任务数
     return true;
 }
 
 // 设置新的处理线程数，退出流程和未初始化的线程池则失败，线程启动时先执行一次启动函数
-template<> bool threadpool<HANDLE_EXCEPTION>::_set_new_thread_number(int thread_number_new, function<void()>&& startup_fn)
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::_set_new_thread_number(int thread_number_new, function<void()>&& startup_fn)
 {
     assert(thread_number_new >= 0 && thread_number_new < 255); // Thread number must greater than or equal 0 and less than 255
     switch (m_exit_event.load())
@@ -289,7 +498,7 @@ template<> bool threadpool<HANDLE_EXCEPTION>::_set_new_thread_number(int thread_
         bool already_create_new_thread = false;
         // 线程创建、销毁事件锁
         unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
-        for (register int i = m_thread_started.load(); i < thread_number_new; i++)
+        for (int i = m_thread_started.load(); i < thread_number_new; i++)
         {
             if (m_thread_destroy.size())
             {
@@ -304,17 +513,19 @@ template<> bool threadpool<HANDLE_EXCEPTION>::_set_new_thread_number(int thread_
                 already_create_new_thread = true;
                 HANDLE thread_exit_event = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
                 HANDLE thread_resume_event = CreateEventW(nullptr, FALSE, FALSE, nullptr); // 自动复位，无信号
+                auto worker = create_worker();
                 m_thread_object.push_back(make_tuple(
-                    thread(thread_entry_startup, this, thread_exit_event, thread_resume_event, startup_fn),
+                    thread(thread_entry_startup, this, thread_exit_event, thread_resume_event, worker, startup_fn),
                     SAFE_HANDLE_OBJECT(thread_exit_event),
-                    SAFE_HANDLE_OBJECT(thread_resume_event)));
+                    SAFE_HANDLE_OBJECT(thread_resume_event),
+                    worker));
             }
             m_thread_started++;
         }
         // 只在创建新线程时设置优先级
         if (already_create_new_thread)
             set_thread_priority(m_priority);
-        for (register int i = m_thread_started.load(); i > thread_number_new; i--)
+        for (int i = m_thread_started.load(); i > thread_number_new; i--)
         {
             auto iter = m_thread_object.begin();
             ResetEvent(get<2>(*iter));  // 取消线程恢复事件
@@ -324,6 +535,8 @@ template<> bool threadpool<HANDLE_EXCEPTION>::_set_new_thread_number(int thread_
             m_thread_started--;
         }
         assert(m_thread_started.load() == thread_number_new);
+        // 线程数改变后重新分配亲和性，包括从已销毁分离的线程中恢复的线程
+        apply_thread_affinity();
         lck.unlock();
     }
     m_is_start = !!m_thread_started.load();
@@ -332,7 +545,7 @@ template<> bool threadpool<HANDLE_EXCEPTION>::_set_new_thread_number(int thread_
 
 
 // 设置线程优先级
-template<> void threadpool<HANDLE_EXCEPTION>::set_thread_priority(thread_priority priority/*=thread_priority::uninitialized*/)
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_thread_priority(thread_priority priority/*=thread_priority::uninitialized*/)
 {
     // 线程创建、销毁事件锁
     unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
@@ -372,50 +585,433 @@ template<> void threadpool<HANDLE_EXCEPTION>::set_thread_priority(thread_priorit
         SetThreadPriority(get<0>(th).native_handle(), _priority);
 #else  /* UNIX */
     struct sched_param _priority;
+    int _policy = SCHED_RR;
+    int _priority_min = sched_get_priority_min(SCHED_RR);
+    int _priority_max = sched_get_priority_max(SCHED_RR);
     switch (m_priority = priority)
     {
     case thread_priority::time_critical:
-        _priority = sched_get_priority_max(SCHED_RR);
+        _priority.sched_priority = _priority_max;
         break;
     case thread_priority::highest:
-        _priority = sched_get_priority_min(SCHED_RR) + (sched_get_priority_max(SCHED_RR) - sched_get_priority_min(SCHED_RR)) * 5 / 6;
+        _priority.sched_priority = _priority_min + (_priority_max - _priority_min) * 5 / 6;
         break;
     case thread_priority::above_normal:
-        _priority = sched_get_priority_min(SCHED_RR) + (sched_get_priority_max(SCHED_RR) - sched_get_priority_min(SCHED_RR)) * 2 / 3;
+        _priority.sched_priority = _priority_min + (_priority_max - _priority_min) * 2 / 3;
         break;
     case thread_priority::normal:
-        _priority = (sched_get_priority_max(SCHED_RR) + sched_get_priority_min(SCHED_RR)) / 2;
+        _priority.sched_priority = (_priority_max + _priority_min) / 2;
         break;
     case thread_priority::below_normal:
-        _priority = sched_get_priority_min(SCHED_RR) + (sched_get_priority_max(SCHED_RR) - sched_get_priority_min(SCHED_RR)) / 3;
+        _priority.sched_priority = _priority_min + (_priority_max - _priority_min) / 3;
         break;
     case thread_priority::lowest:
-        _priority = sched_get_priority_min(SCHED_RR) + (sched_get_priority_max(SCHED_RR) - sched_get_priority_min(SCHED_RR)) / 6 ;
+        _priority.sched_priority = _priority_min + (_priority_max - _priority_min) / 6;
         break;
     case thread_priority::idle:
-        _priority = sched_get_priority_min(SCHED_RR);
+        _priority.sched_priority = _priority_min;
+        break;
+    case thread_priority::none: // 恢复默认调度策略
+        _policy = SCHED_OTHER;
+        _priority.sched_priority = 0;
         break;
-    case thread_priority::none:
-        for (auto& th : m_thread_object)
-            pthread_attr_setinheritsched(get<0>(th).native_handle(), PTHREAD_INHERIT_SCHED);
-        for (auto& th : m_thread_destroy)
-            pthread_attr_setinheritsched(get<0>(th).native_handle(), PTHREAD_INHERIT_SCHED);
-        return;
     case thread_priority::uninitialized:
     default:
         return;
     }
+    // 线程对象的native_handle为pthread_t，直接设置调度策略和优先级（实时策略需要相应权限）
+    for (auto& th : m_thread_object)
+        pthread_setschedparam(get<0>(th).native_handle(), _policy, &_priority);
+    for (auto& th : m_thread_destroy)
+        pthread_setschedparam(get<0>(th).native_handle(), _policy, &_priority);
+#endif  /* _WIN32 */
+}
+
+// 设置线程亲和性
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::set_thread_affinity(thread_affinity affinity, const vector<unsigned>& cpus/*=vector<unsigned>()*/)
+{
+    if (affinity == thread_affinity::uninitialized)
+        return;
+    // 线程创建、销毁事件锁
+    unique_lock<decltype(m_thread_lock)> lck(m_thread_lock);
+    m_affinity = affinity;
+    m_affinity_cpus = cpus;
+    apply_thread_affinity();
+}
+
+// 按线程亲和性设置所有线程的CPU集合和内存节点，已销毁分离的线程在恢复时重新设置
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::apply_thread_affinity()
+{
+    if (m_affinity == thread_affinity::uninitialized || m_thread_object.empty())
+        return;
+    auto&& placements = get_cpu_placements(m_affinity, m_affinity_cpus, m_thread_object.size());
+    if (placements.size() != m_thread_object.size()) // 获取CPU拓扑失败
+        return;
+    size_t index = 0;
     for (auto& th : m_thread_object)
     {
-        pthread_attr_setschedpolicy(get<0>(th).native_handle(), SCHED_RR);
-        pthread_attr_setschedparam(get<0>(th).native_handle(), &_priority);
-        pthread_attr_setinheritsched(get<0>(th).native_handle(), PTHREAD_EXPLICIT_SCHED);
+        auto& placement = placements[index++];
+        set_native_thread_affinity(get<0>(th).native_handle(), placement.cpus);
+        if (get<3>(th))
+            get<3>(th)->memory_node.store(placement.node, memory_order_relaxed);
     }
-    for (auto& th : m_thread_destroy)
+}
+
+// 启动自动调整线程数，已启动时更新配置
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::start_autoscale(const autoscale_config& config/*=autoscale_config()*/)
+{
+    auto max_threads = config.max_threads ? config.max_threads : (int)thread::hardware_concurrency();
+    if (config.min_threads < 0 || max_threads < auto_max(config.min_threads, 1) || max_threads >= 255
+        || config.interval.count() <= 0 || config.shrink_step <= 0 || config.grow_step < 0)
+        return false;
+    switch (m_exit_event.load())
     {
-        pthread_attr_setschedpolicy(get<0>(th).native_handle(), SCHED_RR);
-        pthread_attr_setschedparam(get<0>(th).native_handle(), &_priority);
-        pthread_attr_setinheritsched(get<0>(th).native_handle(), PTHREAD_EXPLICIT_SCHED);
+    case exit_event_t::NORMAL:
+    case exit_event_t::PAUSE:
+        break;
+    default: // 未初始化和退出流程中的线程池将失败
+        return false;
     }
-#endif  /* _WIN32 */
+    lock_guard<mutex> control_lck(m_autoscale_control_lock);
+    if (m_budget.load()) // 线程数由线程预算分配; 和worker_budget::attach在同一个锁内检查
+        return false;
+    unique_lock<mutex> lck(m_autoscale_lock);
+    m_autoscale_config = config;
+    m_autoscale_config.max_threads = max_threads;
+    if (m_autoscale_thread.joinable())
+    { // 已启动，控制线程在下一次采样时使用新配置
+        m_autoscale_cv.notify_all();
+        return true;
+    }
+    m_autoscale_stop = false;
+    m_autoscale_thread = thread([this]{ autoscale_run(); });
+    return true;
+}
+
+// 停止自动调整线程数
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::stop_autoscale()
+{
+    lock_guard<mutex> control_lck(m_autoscale_control_lock);
+    unique_lock<mutex> lck(m_autoscale_lock);
+    if (!m_autoscale_thread.joinable())
+        return;
+    m_autoscale_stop = true;
+    m_autoscale_cv.notify_all();
+    lck.unlock();
+    m_autoscale_thread.join();
+}
+
+// 自动调整线程数的控制线程函数
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::autoscale_run()
+{
+    unique_lock<mutex> lck(m_autoscale_lock);
+    // 上一次调整的时间和已结束的任务数
+    auto last_time = chrono::steady_clock::now();
+    size_t last_finished = m_task_completed.load() + m_task_exception.load() + m_task_cancelled.load();
+    // 线程利用率采样
+    double utilization_sum = 0;
+    size_t samples = 0;
+    // 连续满足增加、减少条件的间隔数
+    size_t grow_count = 0, shrink_count = 0;
+    while (true)
+    {
+        auto sample_interval = auto_max(m_autoscale_config.interval / 8, chrono::milliseconds(1));
+        if (m_autoscale_cv.wait_for(lck, sample_interval, [this]{ return m_autoscale_stop; }))
+            break;
+        auto config = m_autoscale_config;
+        lck.unlock();
+        // 正在运行的任务数由任务计数估计
+        int thread_number = m_thread_started.load();
+        size_t queue_depth = get_tasks_number();
+        size_t finished = m_task_completed.load() + m_task_exception.load() + m_task_cancelled.load();
+        size_t pending = m_task_all.load() - finished;
+        size_t running = pending > queue_depth ? auto_min(pending - queue_depth, (size_t)thread_number) : 0;
+        utilization_sum += thread_number ? (double)running / thread_number : 1.0;
+        samples++;
+        auto now = chrono::steady_clock::now();
+        if (now - last_time < config.interval)
+        {
+            lck.lock();
+            continue;
+        }
+        // 由Little定律估计排队时间：队列数量/完成速度
+        auto elapsed_us = chrono::duration_cast<chrono::microseconds>(now - last_time).count();
+        auto finished_interval = finished - last_finished;
+        auto queue_delay = chrono::microseconds::zero();
+        if (queue_depth)
+            queue_delay = finished_interval ? chrono::microseconds((long long)((double)queue_depth * elapsed_us / finished_interval)) : chrono::microseconds::max();
+        autoscale_decision decision = { now, autoscale_reason::below_minimum, thread_number, thread_number, queue_depth, queue_delay, utilization_sum / samples };
+        last_time = now;
+        last_finished = finished;
+        utilization_sum = 0;
+        samples = 0;
+        if (m_exit_event.load() != exit_event_t::NORMAL) // 暂停中不调整
+        {
+            grow_count = shrink_count = 0;
+            lck.lock();
+            continue;
+        }
+        if (thread_number < config.min_threads)
+            decision.new_thread_number = config.min_threads;
+        else if (thread_number > config.max_threads)
+        {
+            decision.reason = autoscale_reason::above_maximum;
+            decision.new_thread_number = config.max_threads;
+        }
+        else if (thread_number < config.max_threads && (queue_depth >= config.grow_queue_depth * auto_max(thread_number, 1) || queue_delay >= config.grow_delay))
+        {
+            shrink_count = 0;
+            if (++grow_count >= config.grow_hold)
+            {
+                decision.reason = queue_depth >= config.grow_queue_depth * auto_max(thread_number, 1) ? autoscale_reason::queue_depth : autoscale_reason::queue_delay;
+                decision.new_thread_number = auto_min(config.max_threads, thread_number + (config.grow_step ? config.grow_step : auto_max(thread_number, 1)));
+            }
+        }
+        else if (thread_number > config.min_threads && !queue_depth && decision.utilization < config.shrink_utilization)
+        {
+            grow_count = 0;
+            if (++shrink_count >= config.shrink_hold)
+            {
+                decision.reason = autoscale_reason::low_utilization;
+                decision.new_thread_number = auto_max(config.min_threads, thread_number - config.shrink_step);
+            }
+        }
+        else
+            grow_count = shrink_count = 0;
+        if (decision.new_thread_number != thread_number && set_new_thread_number(decision.new_thread_number))
+        {
+            grow_count = shrink_count = 0;
+            if (config.on_decision)
+                config.on_decision(decision);
+            lck.lock();
+            m_autoscale_decisions.push_back(decision);
+            while (m_autoscale_decisions.size() > config.history)
+                m_autoscale_decisions.pop_front();
+        }
+        else
+            lck.lock();
+    }
+}
+
+// 添加定时任务，第一次添加时启动定时器线程; 定时任务堆达到清除大小时先清除已取消的定时任务
+template<> bool threadpool<HANDLE_EXCEPTION, TASK_LOCK>::add_timer(timer_entry&& entry)
+{
+    vector<timer_entry> cancelled;
+    unique_lock<mutex> lck(m_timer_lock);
+    if (m_timer_stop) // 线程池析构中
+        return false;
+    if (!m_timer_thread.joinable())
+        m_timer_thread = thread([this]{ timer_run(); });
+    if (m_timers.size() >= m_timers_purge_size)
+    {
+        auto iter = partition(m_timers.begin(), m_timers.end(), [](const timer_entry& val){ return !val.state->is_cancelled(); });
+        move(iter, m_timers.end(), back_inserter(cancelled));
+        m_timers.erase(iter, m_timers.end());
+        make_heap(m_timers.begin(), m_timers.end());
+        m_timers_purge_size = max((size_t)64, m_timers.size() * 2);
+    }
+    auto state = entry.state.get();
+    m_timers.push_back(move(entry));
+    push_heap(m_timers.begin(), m_timers.end());
+    // 新的定时任务最早到期或者清除了定时任务时唤醒定时器线程
+    if (m_timers.front().state.get() == state || !cancelled.empty())
+        m_timer_cv.notify_one();
+    lck.unlock(); // 已取消的定时任务在锁外销毁
+    return true;
+}
+
+// 停止定时器线程并丢弃未到期的定时任务，之后不能再添加定时任务
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::stop_timer()
+{
+    unique_lock<mutex> lck(m_timer_lock);
+    m_timer_stop = true;
+    m_timer_cv.notify_all();
+    if (m_timer_thread.joinable())
+    {
+        lck.unlock();
+        m_timer_thread.join();
+        lck.lock();
+    }
+    vector<timer_entry> timers;
+    m_timers.swap(timers);
+    lck.unlock(); // 定时任务在锁外销毁
+}
+
+// 定时器线程函数
+template<> void threadpool<HANDLE_EXCEPTION, TASK_LOCK>::timer_run()
+{
+    unique_lock<mutex> lck(m_timer_lock);
+    while (!m_timer_stop)
+    {
+        if (m_timers.empty())
+        {
+            m_timer_cv.wait(lck);
+            continue;
+        }
+        if (m_timers.front().state->is_cancelled())
+        { // 已取消的定时任务到达堆顶时立即移除，不等待到期
+            pop_heap(m_timers.begin(), m_timers.end());
+            auto state = move(m_timers.back().state);
+            m_timers.pop_back();
+            lck.unlock();
+            state.reset(); // 定时任务在锁外销毁
+            lck.lock();
+            continue;
+        }
+        auto now = chrono::steady_clock::now();
+        auto due = m_timers.front().due; // 等待时定时任务堆可能重新分配
+        if (now < due)
+        {
+            m_timer_cv.wait_until(lck, due);
+            continue;
+        }
+        pop_heap(m_timers.begin(), m_timers.end());
+        auto entry = move(m_timers.back());
+        m_timers.pop_back();
+        lck.unlock();
+        // 已取消或线程池退出流程中丢弃; 暂停时和push相同添加到暂停的任务队列
+        bool keep = !entry.state->is_cancelled();
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION:
+            break;
+        default:
+            keep = false;
+            break;
+        }
+        // 上一次添加的任务尚未运行结束时跳过此次运行
+        if (keep && entry.state->set_pending())
+            push_task(task_object(timer_task(entry.state)));
+        if (keep && entry.period.count())
+        {
+            // 按原定时间加周期计算，错过的周期跳过
+            entry.due += entry.period;
+            if (entry.due <= now)
+                entry.due += entry.period * ((now - entry.due) / entry.period + 1);
+            lck.lock();
+            m_timers.push_back(move(entry));
+            push_heap(m_timers.begin(), m_timers.end());
+        }
+        else
+        {
+            entry.state.reset(); // 定时任务在锁外销毁
+            lck.lock();
+        }
+    }
+}
+
+// 超出容量时按处理策略处理count个任务，先按加锁取得的准确任务队列数量再检查一次，估计值偏大时不阻塞或失败
+template<> threadpool<HANDLE_EXCEPTION, TASK_LOCK>::admission threadpool<HANDLE_EXCEPTION, TASK_LOCK>::overflow_tasks(size_t capacity, size_t count)
+{
+    if (has_capacity(capacity, count, get_tasks_number()))
+        return admission::accept;
+    switch (m_overflow_policy.load())
+    {
+    case overflow_policy::fail:
+        m_overflow_rejected += count;
+        return admission::reject;
+    case overflow_policy::caller_runs:
+        m_overflow_caller_runs += count;
+        return admission::caller_runs;
+    case overflow_policy::drop_oldest:
+    { // 丢弃后仍然超出容量（同时有其他线程添加任务）时失败
+        auto depth = get_tasks_number();
+        if (depth + count > capacity)
+            depth -= drop_oldest_tasks(auto_min(depth, depth + count - capacity));
+        if (has_capacity(capacity, count, depth))
+            return admission::accept;
+        m_overflow_rejected += count;
+        return admission::reject;
+    }
+    case overflow_policy::block:
+    default:
+        break;
+    }
+    // 工作线程阻塞可能导致所有线程互相等待，直接添加
+    if (local_worker())
+        return admission::accept;
+    m_overflow_blocked += count;
+    auto timeout = m_block_timeout.load();
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(auto_max(timeout, 0LL));
+    unique_lock<mutex> lck(m_capacity_lock);
+    m_blocked_producers++;
+    while (true)
+    {
+        capacity = m_capacity.load();
+        if (!capacity || has_capacity(capacity, count))
+            break;
+        switch (m_exit_event.load())
+        {
+        case exit_event_t::NORMAL:
+        case exit_event_t::PAUSE:
+        case exit_event_t::INITIALIZATION:
+            break;
+        default: // 退出流程中不再等待，由添加函数处理
+            m_blocked_producers--;
+            return admission::accept;
+        }
+        auto now = chrono::steady_clock::now();
+        if (timeout >= 0 && now >= deadline)
+        {
+            m_blocked_producers--;
+            m_overflow_rejected += count;
+            return admission::reject;
+        }
+        // 估计值无锁读取，分段等待避免错过唤醒; 每次检查时估计值不满足再按准确数量判断
+        auto wake = now + chrono::milliseconds(10);
+        m_capacity_cv.wait_until(lck, timeout >= 0 ? auto_min(wake, deadline) : wake);
+    }
+    m_blocked_producers--;
+    return admission::accept;
+}
+
+/* 丢弃最早的count个任务，返回丢弃的任务数: 从低优先级开始依次丢弃低优先级、普通优先级（暂停时为暂停的任务队列）
+*  和高优先级任务队列中的任务，仍然不足时取回工作线程的批量任务和本地任务队列中的任务继续丢弃
+**/
+template<> size_t threadpool<HANDLE_EXCEPTION, TASK_LOCK>::drop_oldest_tasks(size_t count)
+{
+    decltype(m_tasks) dropped;
+    auto drop_front = [&](decltype(m_tasks)& tasks) -> size_t
+    {
+        size_t number = 0;
+        for (; count && !tasks.empty(); count--, number++)
+        {
+            dropped.push_back(move(tasks.front()));
+            tasks.pop_front();
+        }
+        return number;
+    };
+    auto drop_priority = [&](task_priority priority, decltype(m_tasks)& tasks)
+    {
+        auto number = drop_front(tasks);
+        m_priority_counter[(size_t)priority].total -= number;
+        m_priority_waiting -= number;
+    };
+    unique_lock<decltype(m_task_lock)> lck(m_task_lock);
+    drop_priority(task_priority::low, m_low_tasks);
+    drop_front(*m_push_tasks);
+    drop_priority(task_priority::high, m_high_tasks);
+    if (count)
+    { // 批量任务按原有顺序取回任务队列前端，本地任务取回末尾
+        drain_batch_tasks(*m_push_tasks);
+        drain_local_tasks(*m_push_tasks);
+        drop_front(*m_push_tasks);
+    }
+    lck.unlock();
+    if (dropped.empty())
+        return 0;
+    m_task_all -= dropped.size();
+    m_overflow_dropped += dropped.size();
+    unique_lock<mutex> lck_callback(m_capacity_lock);
+    auto callback = m_drop_callback;
+    lck_callback.unlock();
+    // 在锁外调用回调或销毁任务，pool_future设置为broken_promise
+    if (callback)
+    {
+        for (auto& task : dropped)
+            callback(move(task));
+    }
+    return dropped.size();
 }
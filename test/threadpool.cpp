@@ -1,11 +1,12 @@
 ﻿/**********************************************************
 * 测试线程池 threadpool<>
-* 支持平台：Windows
-* 编译环境：VS2013+
+* 支持平台：Windows; Linux
+* 编译环境：VS2013+; g++ -std=c++11
 ***********************************************************/
 
 // threadpool<> example
 #include <threadpool.h>                 // threadpool<>
+#include <task_graph.h>                 // task_graph
 #include <link_system_constituent.h>    // linker
 
 using namespace std;
@@ -21,6 +22,861 @@ void foo(int length, char c, size_t ms)
     }
 }
 
+// 只能移动的函数对象
+struct move_only_task
+{
+    unique_ptr<int> value;
+    void operator()(){ debug_output<true>(_T("move only task: "), *value); }
+};
+
+#if defined(_WIN32) || defined(WIN32)
+static const tstring event_backend = _T("Win32 Event");
+#else // UNIX
+static const tstring event_backend = _T("POSIX Event");
+#endif // #if defined(_WIN32) || defined(WIN32)
+
+// 唤醒延迟：空闲的线程池添加任务到任务开始执行的时间
+template<bool handle_exception> void test_wakeup_latency(threadpool<handle_exception>& thpool, int count)
+{
+    long long total_ns = 0, max_ns = 0;
+    for (int i = 0; i < count; i++)
+    {
+        this_thread::sleep_for(milliseconds(1)); // 等待工作线程进入空闲等待
+        auto push_time = steady_clock::now();
+        auto fut = thpool.push_future([]{ return steady_clock::now(); });
+        if (!fut.second)
+            return;
+        auto ns = duration_cast<nanoseconds>(fut.first.get() - push_time).count();
+        total_ns += ns;
+        max_ns = auto_max(max_ns, ns);
+    }
+    debug_output<true>(event_backend, _T(" wakeup latency: avg "), total_ns / count, _T("ns, max "), max_ns, _T("ns"));
+}
+
+// 空闲策略：间隔gap_us突发添加短任务，统计添加到开始执行的p50/p99延迟
+template<bool handle_exception> void test_idle_policy(threadpool<handle_exception>& thpool, idle_policy policy, const tstring& name, int count, int gap_us)
+{
+    thpool.set_idle_policy(policy);
+    vector<long long> samples;
+    samples.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        auto gap_end = steady_clock::now() + microseconds(gap_us);
+        while (steady_clock::now() < gap_end); // 短间隔，工作线程可能仍在自旋
+        auto push_time = steady_clock::now();
+        auto fut = thpool.push_future([]{ return steady_clock::now(); });
+        if (!fut.second)
+            return;
+        samples.push_back(duration_cast<nanoseconds>(fut.first.get() - push_time).count());
+    }
+    sort(samples.begin(), samples.end());
+    debug_output<true>(_T("idle policy "), name, _T(" gap "), gap_us, _T("us: p50 "), samples[samples.size() / 2], _T("ns, p99 "), samples[samples.size() * 99 / 100], _T("ns"));
+    thpool.set_idle_policy(idle_policy::park);
+}
+
+// 吞吐量：连续添加空任务到任务全部执行完毕
+template<bool handle_exception> void test_throughput(threadpool<handle_exception>& thpool, size_t count)
+{
+    auto completed = thpool.get_tasks_completed_number();
+    auto begin = steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+        thpool.push([]{});
+    while (thpool.get_tasks_completed_number() - completed < count)
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(event_backend, _T(" push-to-execute throughput: "), count * 1000000000ull / (ns ? ns : 1), _T(" tasks/s"));
+}
+
+// 在工作线程中递归添加任务，共2^(depth+1)-1个任务
+template<bool handle_exception> void spawn_tree(threadpool<handle_exception>* thpool, int depth)
+{
+    if (depth-- > 0)
+    {
+        thpool->push(spawn_tree<handle_exception>, thpool, depth);
+        thpool->push(spawn_tree<handle_exception>, thpool, depth);
+    }
+}
+
+// 调度模式扩展性：线程数从1到全部核心
+void test_schedule_scaling(schedule_mode mode, int depth)
+{
+    int max_thread_number = auto_max(1, (int)thread::hardware_concurrency());
+    size_t count = ((size_t)2 << depth) - 1;
+    for (int thread_number = 1; ; thread_number = auto_min(thread_number * 2, max_thread_number))
+    {
+        threadpool<false> thpool(thread_number);
+        thpool.set_schedule_mode(mode);
+        auto begin = steady_clock::now();
+        thpool.push(spawn_tree<false>, &thpool, depth);
+        while (thpool.get_tasks_completed_number() < count)
+            this_thread::yield();
+        auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+        debug_output<true>(mode == schedule_mode::work_stealing ? _T("work_stealing") : _T("shared_queue"),
+            _T(" threads: "), thread_number, _T(" throughput: "), count * 1000000000ull / (ns ? ns : 1), _T(" tasks/s"));
+        if (thread_number == max_thread_number)
+            break;
+    }
+}
+
+// 任务优先级：暂停时添加普通、低优先级任务和一个高优先级任务，启动后查看执行顺序
+void test_task_priority(size_t aging)
+{
+    threadpool<false> thpool(1);
+    threadpool_view view(&thpool);
+    thpool.set_priority_aging(aging);
+    thpool.pause();
+    size_t order = 0, high_order = 0, low_order = 0;
+    for (int i = 0; i < 1000; i++)
+        thpool.push([&]{ order++; });
+    for (int i = 0; i < 10; i++)
+        thpool.push_priority(task_priority::low, [&]{ if (!low_order) low_order = order + 1; order++; });
+    thpool.push_priority(task_priority::high, [&]{ high_order = ++order; });
+    thpool.start();
+    while (thpool.get_tasks_completed_number() < 1011)
+        this_thread::yield();
+    debug_output<true>(_T("priority aging "), aging, _T(": high task order "), high_order, _T(", first low task order "), low_order,
+        _T(", low tasks "), view.get_tasks_total_number(task_priority::low), _T(" aged "), view.get_tasks_aged_number(task_priority::low));
+}
+
+// 延续任务：then链式调度对比在调用线程中阻塞get后再添加下一个任务
+template<bool handle_exception> void test_future_then(threadpool<handle_exception>& thpool, int count)
+{
+    auto begin = steady_clock::now();
+    int value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        auto fut = thpool.push_future([](int v){ return v + 1; }, value);
+        if (!fut.second)
+            return;
+        value = fut.first.get();
+    }
+    auto get_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+    begin = steady_clock::now();
+    auto fut = thpool.push_pool_future([]{ return 0; });
+    if (!fut.second)
+        return;
+    auto chain = fut.first;
+    for (int i = 0; i < count; i++)
+        chain = chain.then([](const pool_future<int>& f){ return f.get() + 1; });
+    auto then_value = chain.get();
+    auto then_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+    // 产生future的线程池析构（等待任务完成）后添加延续任务：在调用线程中直接运行
+    pool_future<int> orphan;
+    {
+        threadpool<handle_exception> producer(1);
+        orphan = producer.push_pool_future([]{ return 1; }).first;
+    }
+    auto orphan_value = orphan.then([](const pool_future<int>& f){ return f.get() + 1; }).get();
+    debug_output<true>(_T("future chain "), count, _T(": blocking get "), get_ns / 1000, _T("us, then "), then_ns / 1000,
+        _T("us, result "), value == then_value && orphan_value == 2 ? _T("ok") : _T("mismatch"));
+}
+
+// 任务图：分层的依赖图重复运行，对比每层添加任务后阻塞等待future
+template<bool handle_exception> void test_task_graph(threadpool<handle_exception>& thpool, int layers, int width, int rounds)
+{
+    atomic<size_t> executed{ 0 };
+    auto work = [&]
+    {
+        volatile size_t sum = 0;
+        for (size_t i = 0; i < 1000; i++)
+            sum = sum + i;
+        executed++;
+    };
+    auto begin = steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int layer = 0; layer < layers; layer++)
+        {
+            auto fut = thpool.push_multi_future(width, work);
+            if (fut.second)
+                for (auto& f : fut.first)
+                    f.get();
+        }
+    }
+    auto future_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+    // 每个节点依赖上一层的3个节点
+    task_graph graph;
+    for (int layer = 0; layer < layers; layer++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            auto id = graph.add_node(work);
+            if (layer)
+                for (int j = 0; j < 3; j++)
+                    graph.add_edge(id - width - i + (i + j) % width, id);
+        }
+    }
+    begin = steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        graph.run(thpool);
+    auto graph_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    // 再次运行不分配内存：节点任务直接保存在任务对象内部
+    auto before = task_arena::get_statistics();
+    graph.run(thpool);
+    auto after = task_arena::get_statistics();
+    debug_output<true>(_T("task graph "), graph.size(), _T(" nodes x "), rounds, _T(": layered futures "), future_ns / 1000,
+        _T("us, task_graph "), graph_ns / 1000, _T("us, executed "), executed.load(), _T(", allocations per run "),
+        after.allocations - before.allocations, after.allocations == before.allocations ? _T(" ok") : _T(" mismatch"));
+
+    // 暂停时添加的节点任务被清理：任务图以broken_promise结束，不会一直等待
+    task_graph abandoned;
+    for (int i = 0; i < 3; i++)
+        abandoned.add_node(work);
+    thpool.pause();
+    auto abandoned_fut = async(launch::async, [&]{ return abandoned.run(thpool); });
+    while (thpool.get_tasks_number() < 2)
+        this_thread::yield();
+    thpool.clear();
+    thpool.start();
+    bool broken_promise = false;
+    try
+    {
+        abandoned_fut.get();
+    }
+    catch (future_error& e)
+    {
+        broken_promise = e.code() == future_errc::broken_promise;
+    }
+    // 单线程线程池的工作线程中运行任务图，等待时帮助运行节点任务
+    threadpool<handle_exception> single(1);
+    auto nested = single.push_future([&]{ return graph.run(single); });
+    bool nested_done = nested.second && nested.first.wait_for(seconds(5)) == future_status::ready;
+    debug_output<true>(_T("task graph abandoned: "), broken_promise ? _T("broken_promise") : _T("not failed"),
+        _T(", nested in single thread pool: "), nested_done ? _T("ok") : _T("timeout"));
+}
+
+#ifdef THREADPOOL_COROUTINE
+// 协程：co_await schedule()在工作线程中恢复，co_await子协程和pool_future时不占用线程
+coroutine_task<int> coroutine_add(threadpool<false>& thpool, int a, int b)
+{
+    co_await thpool.schedule();
+    co_return a + b;
+}
+coroutine_task<int> coroutine_sum(threadpool<false>& thpool, int count)
+{
+    int sum = 0;
+    for (int i = 0; i < count; i++)
+        sum += co_await coroutine_add(thpool, i, 1);
+    auto fut = thpool.push_pool_future([]{ return 100; });
+    if (fut.second)
+        sum += co_await fut.first;
+    co_return sum;
+}
+// 任务队列已满（overflow_policy::fail）时co_await schedule()抛出std::future_errc::broken_promise异常
+coroutine_task<int> coroutine_rejected(threadpool<false>& full_pool)
+{
+    bool rejected = false;
+    try
+    {
+        co_await full_pool.schedule();
+    }
+    catch (future_error&)
+    {
+        rejected = true;
+    }
+    co_return rejected ? -1 : 0;
+}
+#endif // #ifdef THREADPOOL_COROUTINE
+
+// 并行归约：parallel_reduce对比push_multi_future手动分块
+template<bool handle_exception> void test_parallel_reduce(threadpool<handle_exception>& thpool, size_t count, size_t grain)
+{
+    auto value = [](size_t i){ return (unsigned long long)(i % 1000) * (i % 1000); };
+    auto begin = steady_clock::now();
+    atomic<size_t> next_chunk{ 0 };
+    auto fut = thpool.push_multi_future((count + grain - 1) / grain, [&]
+    {
+        unsigned long long partial = 0;
+        auto first = next_chunk++ * grain;
+        for (auto i = first; i < auto_min(first + grain, count); i++)
+            partial += value(i);
+        return partial;
+    });
+    unsigned long long result_future = 0;
+    if (fut.second)
+        for (auto& f : fut.first)
+            result_future += f.get();
+    auto future_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+    begin = steady_clock::now();
+    auto result_reduce = thpool.parallel_reduce((size_t)0, count, grain, 0ull, value, plus<unsigned long long>());
+    auto reduce_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    assert(result_future == result_reduce);
+    debug_output<true>(_T("reduce "), count, _T(" grain "), grain, _T(": push_multi_future "), future_ns / 1000,
+        _T("us, parallel_reduce "), reduce_ns / 1000, _T("us, result "), result_reduce == result_future ? _T("ok") : _T("mismatch"));
+}
+
+
+// 批量取出任务：比较不同批量大小添加到执行完毕的吞吐量; 执行中暂停，检查任务计数不丢失
+void test_batch_dequeue(size_t batch_size, size_t count)
+{
+    threadpool<false> thpool(4);
+    thpool.set_batch_size(batch_size);
+    atomic<size_t> executed{ 0 };
+    auto begin = steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+        thpool.push([&]{ executed++; });
+    thpool.pause();
+    auto paused_executed = executed.load();
+    this_thread::sleep_for(milliseconds(10)); // 暂停后最多再运行已开始的任务
+    auto stable = executed.load() - paused_executed <= (size_t)thpool.get_thread_number();
+    auto counted = thpool.get_tasks_number() + thpool.get_tasks_completed_number() == count;
+    thpool.start();
+    while (thpool.get_tasks_completed_number() < count)
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    // 清理任务队列时一并清理已取出到工作线程的批量任务，之后最多再运行已开始的任务
+    for (size_t i = 0; i < 400; i++)
+        thpool.push([&]{ this_thread::sleep_for(milliseconds(2)); executed++; });
+    this_thread::sleep_for(milliseconds(10));
+    thpool.clear();
+    auto cleared_executed = executed.load();
+    auto cleared_tasks = thpool.get_tasks_number();
+    this_thread::sleep_for(milliseconds(20));
+    auto cleared = !cleared_tasks && executed.load() - cleared_executed <= (size_t)thpool.get_thread_number();
+    debug_output<true>(_T("batch "), batch_size, _T(": "), count * 1000000000ull / (ns ? ns : 1), _T(" tasks/s, executed "), cleared_executed,
+        _T(", pause "), stable && counted ? _T("ok") : _T("mismatch"), _T(", clear "), cleared ? _T("ok") : _T("mismatch"));
+}
+
+
+// 批量添加：逐个push_future（每个任务一个共享状态，每次加锁）和push_bulk（一个共享状态，加锁一次）添加到全部完成的时间
+template<bool handle_exception> void test_bulk_submit(threadpool<handle_exception>& thpool, size_t count)
+{
+    auto begin = steady_clock::now();
+    vector<future<size_t>> futures;
+    futures.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        futures.push_back(thpool.push_future([i]{ return i; }).first);
+    size_t sum_loop = 0;
+    for (auto& val : futures)
+        sum_loop += val.get();
+    auto loop_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+    begin = steady_clock::now();
+    auto bulk = thpool.push_bulk(count, [](size_t i){ return [i]{ return i; }; });
+    size_t sum_bulk = 0;
+    for (size_t i = 0; i < count; i++)
+        sum_bulk += bulk.first.get(i);
+    auto bulk_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(_T("bulk "), count, _T(" tasks: push_future loop "), loop_ns / (long long)count, _T("ns/task, push_bulk "), bulk_ns / (long long)count,
+        _T("ns/task, result "), sum_loop == sum_bulk && sum_bulk == count * (count - 1) / 2 ? _T("ok") : _T("mismatch"));
+}
+
+// 任务分发：三个线程池中一个暂停且有大量排队任务，比较各分发策略分发到每个线程池的任务数和每个任务的分发时间
+void test_dispatcher(size_t count)
+{
+    threadpool<false> busy(2), idle1(2);
+    threadpool<true> idle2(2);
+    busy.pause();
+    for (size_t i = 0; i < 10000; i++)
+        busy.push([]{});
+    threadpool_multi_view view(&busy);
+    view.set_pointer(&idle1);
+    view.set_pointer(&idle2);
+    const dispatch_policy policies[] = { dispatch_policy::round_robin, dispatch_policy::least_loaded, dispatch_policy::power_of_two_choices };
+    const tstring names[] = { _T("round robin"), _T("least loaded"), _T("power of two choices") };
+    atomic<size_t> completed(0);
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        threadpool_dispatcher dispatcher(view, policies[i]);
+        auto begin = steady_clock::now();
+        for (size_t j = 0; j < count; j++)
+            dispatcher.push([&completed]{ completed++; });
+        auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+        auto numbers = dispatcher.get_dispatched_numbers();
+        // 按负载分发时不添加到暂停的线程池
+        bool ok = numbers.size() == 3 && numbers[0] + numbers[1] + numbers[2] == count && (policies[i] == dispatch_policy::round_robin || !numbers[0]);
+        debug_output<true>(_T("dispatcher "), names[i], _T(": "), ns / (long long)count, _T("ns/task, dispatched "), numbers[0], _T('/'), numbers[1], _T('/'), numbers[2],
+            _T(", service time "), dispatcher.get_service_time(1).count(), _T("ns, "), ok ? _T("ok") : _T("mismatch"));
+    }
+    busy.start();
+    busy.stop_on_completed();
+    idle1.stop_on_completed();
+    idle2.stop_on_completed();
+    // stop_on_completed不等待任务完成，限时等待所有任务完成后再检查
+    for (auto deadline = steady_clock::now() + seconds(10); completed != count * 3 && steady_clock::now() < deadline;)
+        this_thread::yield();
+    if (completed != count * 3)
+        debug_output<true>(_T("dispatcher completed mismatch: "), completed.load());
+}
+
+// 线程预算：三个线程池共享4个线程，权重2:1:1，空闲线程池的份额借给有排队任务的线程池，需要时收回
+void test_worker_budget()
+{
+    budget_config config;
+    config.total_threads = 4;
+    config.interval = chrono::milliseconds(3600000); // 只由rebalance分配
+    config.shrink_hold = 0;
+    worker_budget budget(config);
+    threadpool<false> pool_a(4), pool_b(4), pool_c(4); // 共12个线程，超出预算
+    budget_share share_a, share;
+    share_a.weight = 2;
+    share_a.min_threads = 0;
+    share.min_threads = 0;
+    bool ok = budget.attach(pool_a, share_a) && budget.attach(pool_b, share) && budget.attach(pool_c, share) && !budget.attach(pool_a, share);
+    auto thread_numbers = [&]{ return make_tuple(pool_a.get_thread_number(), pool_b.get_thread_number(), pool_c.get_thread_number()); };
+    budget.rebalance(); // 都空闲：按需要的线程数（最小为0）收回
+    auto idle = thread_numbers();
+    atomic<bool> gate(false);
+    auto blocked = [&gate]{ while (!gate) this_thread::sleep_for(chrono::microseconds(100)); };
+    for (int i = 0; i < 8; i++)
+        pool_a.push(blocked);
+    budget.rebalance(); // 只有pool_a有任务：借入全部线程
+    auto borrowed = thread_numbers();
+    for (int i = 0; i < 2; i++)
+        pool_b.push(blocked);
+    budget.rebalance(); // pool_b需要线程：收回保证的1个线程，其余仍借给pool_a
+    auto reclaimed = thread_numbers();
+    gate = true;
+    pool_a.stop_on_completed();
+    pool_b.stop_on_completed();
+    // 同时加入预算和启动自动调整线程数：只有一个成功
+    for (int i = 0; i < 10; i++)
+    {
+        worker_budget race_budget(config);
+        threadpool<false> pool_d(1);
+        bool autoscaled = false;
+        thread th([&]{ autoscaled = pool_d.start_autoscale(); });
+        bool attached = race_budget.attach(pool_d, share);
+        th.join();
+        ok = ok && attached != autoscaled;
+    }
+    ok = ok && idle == make_tuple(0, 0, 0) && borrowed == make_tuple(4, 0, 0) && reclaimed == make_tuple(3, 1, 0);
+    debug_output<true>(_T("worker budget 4 threads, weights 2:1:1: idle "), get<0>(idle), get<1>(idle), get<2>(idle),
+        _T(", pool a busy "), get<0>(borrowed), get<1>(borrowed), get<2>(borrowed),
+        _T(", pool a and b busy "), get<0>(reclaimed), get<1>(reclaimed), get<2>(reclaimed), _T(", "), ok ? _T("ok") : _T("mismatch"));
+}
+
+// 分离任务：暂停的线程池中的count个任务分离到新的线程池或者共享的后台线程池，比较分离调用返回和任务全部完成的时间
+void test_detach(size_t count, int rounds)
+{
+    for (int shared = 0; shared < 2; shared++)
+    {
+        long long detach_ns = 0, complete_ns = 0;
+        bool ok = true;
+        for (int round = 0; round <= rounds; round++) // 第一轮预热，不计时
+        {
+            threadpool<true> thpool(2);
+            thpool.pause();
+            atomic<size_t> completed(0);
+            for (size_t i = 0; i < count; i++)
+                thpool.push([&completed]{ completed++; });
+            if (shared)
+                thpool.push([]{ throw runtime_error("detached failure"); });
+            auto failures = make_shared<deque<task_failure>>();
+            auto before = task_arena::get_statistics();
+            auto begin = steady_clock::now();
+            auto fut = shared ? thpool.detach_shared(failures) : thpool.detach_future(2);
+            auto detached = steady_clock::now();
+            // 共享分离的任务只保存序号，不额外分配
+            ok = ok && (!shared || task_arena::get_statistics().allocations == before.allocations);
+            auto result = fut.get();
+            auto end = steady_clock::now();
+            // 分离的任务不再计入估计的任务队列数量; 共享分离时只记录本次分离的异常任务
+            ok = ok && result == threadpool<true>::success_code + 0xff && completed == count && thpool.get_tasks_number() == 0 &&
+                thpool.get_tasks_number_estimate() == 0 && failures->size() == (size_t)shared;
+            if (round)
+            {
+                detach_ns += duration_cast<nanoseconds>(detached - begin).count();
+                complete_ns += duration_cast<nanoseconds>(end - begin).count();
+            }
+        }
+        debug_output<true>(shared ? _T("detach_shared ") : _T("detach_future "), count, _T(" tasks: return "), detach_ns / rounds / 1000,
+            _T("us, complete "), complete_ns / rounds / 1000, _T("us, "), ok ? _T("ok") : _T("mismatch"));
+    }
+}
+
+// 失败的任务：每failure_every个任务中一个在前transient次运行时抛出异常，一个总是抛出异常
+struct failing_task
+{
+    size_t index;
+    size_t failure_every;
+    size_t transient;
+    size_t runs;
+    void operator()()
+    {
+        runs++;
+        if (failure_every && index % failure_every == 0 && runs <= transient)
+            throw runtime_error("transient failure");
+        if (failure_every && index % failure_every == failure_every / 2)
+            throw runtime_error("permanent failure");
+    }
+};
+
+// 异常任务：按比例抛出异常时的吞吐量，异常任务记录的数量、运行次数和异常
+void test_task_failures(size_t count, size_t failure_every, size_t max_retries)
+{
+    threadpool<true> thpool(4);
+    thpool.set_retry_policy(max_retries);
+    auto begin = steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+        thpool.push(failing_task{ i, failure_every, 1, 0 });
+    while (thpool.get_tasks_completed_number() + thpool.get_tasks_exception_number() < count)
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    auto failures = thpool.get_task_failures();
+    size_t expected = failure_every ? (count + failure_every / 2) / failure_every : 0; // 总是抛出异常的任务
+    if (!max_retries && failure_every)
+        expected += (count + failure_every - 1) / failure_every; // 不重试时第一次运行抛出异常的任务
+    bool ok = failures.size() == expected && thpool.get_tasks_exception_number() == expected;
+    for (auto& failure : failures)
+    {
+        ok = ok && failure.attempts == max_retries + 1; // 重试后记录的只有总是抛出异常的任务
+        try
+        {
+            rethrow_exception(failure.exception);
+        }
+        catch (runtime_error&)
+        {
+        }
+        catch (...)
+        {
+            ok = false;
+        }
+    }
+    debug_output<true>(_T("task failures 1/"), failure_every, _T(" of "), count, _T(", retries "), max_retries, _T(": "), ns / (long long)count,
+        _T("ns/task, failed "), failures.size(), _T(", retried "), thpool.get_tasks_retried_number(), _T(", "), ok ? _T("ok") : _T("mismatch"));
+}
+
+// 任务分配器：预热后再次添加同样数量的push_future、push_pool_future任务，统计向系统申请内存的次数和批量归还的次数
+template<bool handle_exception> void test_task_arena(threadpool<handle_exception>& thpool, size_t count)
+{
+    auto run_round = [&]
+    {
+        vector<future<size_t>> futures;
+        vector<pool_future<size_t>> pool_futures;
+        futures.reserve(count);
+        pool_futures.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            futures.push_back(thpool.push_future([i]{ return i; }).first);
+            pool_futures.push_back(thpool.push_pool_future([i]{ return i; }).first);
+        }
+        size_t sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += futures[i].get() + pool_futures[i].get();
+        return sum;
+    };
+    auto enabled = task_arena::is_enabled();
+    task_arena::set_enabled(false);
+    auto begin = steady_clock::now();
+    run_round();
+    auto system_ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    task_arena::set_enabled(true);
+    run_round(); // 预热，各线程的缓存槽分配缓存块
+    auto before = task_arena::get_statistics();
+    begin = steady_clock::now();
+    auto sum = run_round();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    auto after = task_arena::get_statistics();
+    task_arena::set_enabled(enabled);
+    debug_output<true>(_T("task arena "), count, _T(" futures: "), ns / (long long)(count * 2), _T("ns/task (system "), system_ns / (long long)(count * 2),
+        _T("ns/task), allocations "), after.allocations - before.allocations,
+        _T(", slab allocations "), after.slab_allocations - before.slab_allocations, _T(", large "), after.large_allocations - before.large_allocations,
+        _T(", remote frees "), after.remote_frees - before.remote_frees, _T(" in "), after.remote_batches - before.remote_batches, _T(" batches, reserved "),
+        after.reserved_bytes / 1024, _T("KB, result "), sum == count * (count - 1) ? _T("ok") : _T("mismatch"));
+}
+
+// 等待时帮助运行：线程数少于外层任务数，外层任务在工作线程中等待内层任务的future，阻塞等待会使所有线程互相等待
+void test_help_wait(int thread_number, size_t count, size_t inner)
+{
+    threadpool<> thpool(thread_number);
+    auto begin = steady_clock::now();
+    vector<future<size_t>> outer;
+    for (size_t i = 0; i < count; i++)
+        outer.push_back(thpool.push_future([&thpool, inner]
+        {
+            auto_wait_future<size_t> nested;
+            vector<pool_future<size_t>> futures;
+            for (size_t j = 0; j < inner; j++)
+                futures.push_back(nested.push(thpool.push_pool_future([j]{ return j; })));
+            nested.wait(); // 工作线程中等待时运行其他任务
+            size_t sum = 0;
+            for (auto& val : futures)
+                sum += thpool.help_get(val);
+            return sum;
+        }).first);
+    size_t sum = 0;
+    for (auto& val : outer)
+        sum += thpool.help_get(val); // 非工作线程阻塞等待
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(_T("help wait "), count, _T(" x "), inner, _T(" tasks on "), thread_number, _T(" threads: "), ns / (long long)(count * (inner + 1)),
+        _T("ns/task, result "), sum == count * inner * (inner - 1) / 2 ? _T("ok") : _T("mismatch"));
+}
+
+#ifdef THREADPOOL_HISTOGRAM
+// 任务延迟统计：短任务和1ms任务混合，通过视图读取排队延迟和运行时间的百分位数，检查记录数和按类型统计
+void test_task_histogram(size_t count)
+{
+    threadpool<false> thpool(4);
+    thpool.set_type_histogram(true);
+    threadpool_multi_view view(&thpool);
+    for (size_t i = 0; i < count; i++)
+        thpool.push([]{});
+    for (size_t i = 0; i < count / 100; i++)
+        thpool.push([]{ this_thread::sleep_for(milliseconds(1)); });
+    auto total = thpool.get_tasks_total_number();
+    while (thpool.get_tasks_completed_number() < total)
+        this_thread::sleep_for(milliseconds(1));
+    auto histogram = view.get_task_histogram();
+    auto types = view.get_type_histograms();
+    debug_output<true>(_T("histogram "), count, _T(" tasks: queue delay p50 "), histogram.queue_delay.percentile(50).count() / 1000,
+        _T("us, p99 "), histogram.queue_delay.percentile(99).count() / 1000, _T("us, execution p50 "), histogram.execution.percentile(50).count(),
+        _T("ns, p99.9 "), histogram.execution.percentile(99.9).count(), _T("ns, max "), histogram.execution.maximum().count() / 1000,
+        _T("us, count "), histogram.execution.count == total && histogram.queue_delay.count == total ? _T("ok") : _T("mismatch"),
+        _T(", types "), types.size());
+    thpool.reset_task_histogram();
+}
+#endif
+
+// 定时任务：一个定时器线程服务大量延迟任务，统计实际运行时间相对到期时间的延迟; 周期任务运行若干次后取消，之后不再运行
+template<bool handle_exception> void test_timer(threadpool<handle_exception>& thpool, size_t count)
+{
+    atomic<long long> late_ns{ 0 }, max_late_ns{ 0 };
+    atomic<size_t> executed{ 0 };
+    auto begin = steady_clock::now();
+    vector<timer_handle> handles;
+    for (size_t i = 0; i < count; i++)
+    {
+        auto due = begin + milliseconds(1 + i % 20);
+        handles.push_back(thpool.push_at(due, [&, due]
+        {
+            auto late = duration_cast<nanoseconds>(steady_clock::now() - due).count();
+            late_ns += late;
+            auto current = max_late_ns.load();
+            while (late > current && !max_late_ns.compare_exchange_weak(current, late))
+                ;
+            executed++;
+        }).first);
+    }
+    // 取消一半，只有另一半运行
+    size_t cancelled = 0;
+    for (size_t i = 0; i < count; i += 2)
+        cancelled += handles[i].cancel() ? 1 : 0;
+    atomic<size_t> ticks{ 0 };
+    auto periodic = thpool.push_every(milliseconds(2), [&]{ ticks++; }).first;
+    while (ticks.load() < 10)
+        this_thread::sleep_for(milliseconds(1));
+    periodic.cancel();
+    auto ticks_cancelled = ticks.load();
+    while (executed.load() + cancelled < count)
+        this_thread::sleep_for(milliseconds(1));
+    this_thread::sleep_for(milliseconds(10));
+    // 取消很久以后到期的定时任务：不再计入定时任务数，一次性任务捕获的对象立即释放
+    auto captured = make_shared<int>(0);
+    auto distant = thpool.push_after(hours(1), [captured]{}).first;
+    distant.cancel();
+    auto released = captured.use_count() == 1;
+    debug_output<true>(_T("timer "), count, _T(" tasks: executed "), executed.load(), _T(", cancelled "), cancelled,
+        _T(", mean late "), late_ns.load() / (long long)(executed.load() ? executed.load() : 1) / 1000, _T("us, max late "), max_late_ns.load() / 1000,
+        _T("us, periodic "), ticks.load() - ticks_cancelled <= 1 ? _T("ok") : _T("mismatch"), _T(", timers left "), thpool.get_timers_number(),
+        _T(", cancelled release "), released ? _T("ok") : _T("mismatch"));
+}
+
+// 取消令牌：暂停时添加两组任务并取消其中一组，恢复后只有另一组运行，取消的任务只计入取消任务数; 取消的push_future_cancellable为broken_promise
+void test_cancellation(size_t count)
+{
+    threadpool<false> thpool(4);
+    cancellation_source cancelled_request, running_request;
+    atomic<size_t> executed{ 0 };
+    thpool.pause();
+    for (size_t i = 0; i < count; i++)
+    {
+        thpool.push_cancellable(cancelled_request.get_token(), [&]{ executed++; });
+        thpool.push_cancellable(running_request.get_token(), [&]{ executed++; });
+    }
+    auto fut = thpool.push_future_cancellable(cancelled_request.get_token(), []{ return 1; });
+    auto begin = steady_clock::now();
+    cancelled_request.cancel();
+    thpool.start();
+    auto total = thpool.get_tasks_total_number();
+    while (thpool.get_tasks_completed_number() + thpool.get_tasks_cancelled_number() < total)
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    bool broken = false;
+    try
+    {
+        fut.first.get();
+    }
+    catch (future_error& e)
+    {
+        broken = e.code() == future_errc::broken_promise;
+    }
+    debug_output<true>(_T("cancel "), count, _T(" of "), count * 2, _T(" tasks: "), ns / 1000, _T("us, executed "), executed.load(),
+        _T(", cancelled "), thpool.get_tasks_cancelled_number(), _T(", future "), broken ? _T("ok") : _T("mismatch"));
+}
+
+// 有界任务队列：生产者持续添加任务，按处理策略统计添加失败、调用线程运行和丢弃的任务数，以及任务队列最大长度
+void test_bounded_queue(overflow_policy policy, const tstring& name, size_t capacity, size_t count)
+{
+    threadpool<false> thpool(2);
+    thpool.set_capacity(capacity, policy);
+    thpool.set_block_timeout(milliseconds(1000));
+    atomic<size_t> executed{ 0 }, dropped{ 0 };
+    thpool.set_drop_callback([&](task_object&&){ dropped++; });
+    auto begin = steady_clock::now();
+    size_t accepted = 0;
+    for (size_t i = 0; i < count; i++)
+        if (thpool.push([&]{ executed++; }))
+            accepted++;
+    while (thpool.get_tasks_completed_number() < thpool.get_tasks_total_number())
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    auto stats = thpool.get_queue_statistics();
+    debug_output<true>(_T("bounded queue "), name, _T(": "), ns / count, _T("ns/task, accepted "), accepted, _T(", executed "), executed.load(),
+        _T(", high water "), stats.high_water, _T('/'), stats.capacity, _T(", blocked "), stats.blocked, _T(", rejected "), stats.rejected,
+        _T(", caller runs "), stats.caller_runs, _T(", dropped "), stats.dropped, _T('/'), dropped.load());
+    if (policy == overflow_policy::drop_oldest)
+    { // 积压在低优先级任务队列中时同样丢弃，不超出容量
+        threadpool<false> paused(1);
+        paused.pause();
+        paused.set_capacity(8, policy);
+        for (size_t i = 0; i < 8; i++)
+            paused.push_priority(task_priority::low, []{});
+        for (size_t i = 0; i < 4; i++)
+            paused.push([]{});
+        auto depth = paused.get_tasks_number();
+        auto low = paused.get_tasks_number(task_priority::low);
+        paused.clear();
+        debug_output<true>(_T("bounded queue drop_oldest low priority backlog: depth "), depth, _T(", low "), low,
+            _T(", "), depth == 8 && low == 4 ? _T("ok") : _T("mismatch"));
+    }
+}
+
+// 线程亲和性对内存密集任务的影响：任务在工作线程中分配并首次访问缓冲区，顺序读写测带宽，依赖链随机读测缓存未命中延迟
+void test_thread_affinity(thread_affinity affinity, const tstring& name)
+{
+    const size_t length = 1 << 20; // 每个任务8MB
+    threadpool<false> thpool(thread::hardware_concurrency() ? thread::hardware_concurrency() : 4);
+    thpool.set_thread_affinity(affinity);
+    auto task_number = thpool.get_thread_number() * 4;
+    atomic<long long> stream_ns{ 0 }, chase_ns{ 0 };
+    atomic<size_t> checksum{ 0 };
+    auto begin = steady_clock::now();
+    auto fut = thpool.push_multi_future(task_number, [&]
+    {
+        vector<size_t> buffer(length);
+        auto stream_begin = steady_clock::now();
+        for (int pass = 0; pass < 4; pass++)
+            for (size_t i = 0; i < length; i++)
+                buffer[i] = buffer[i] * 3 + i;
+        // 满周期线性同余序列，依赖链遍历所有元素
+        for (size_t i = 0; i < length; i++)
+            buffer[i] = (size_t)((i * 6364136223846793005ull + 1442695040888963407ull) & (length - 1));
+        auto chase_begin = steady_clock::now();
+        size_t index = 0;
+        for (size_t i = 0; i < length; i++)
+            index = buffer[index];
+        auto chase_end = steady_clock::now();
+        checksum += index;
+        stream_ns += duration_cast<nanoseconds>(chase_begin - stream_begin).count();
+        chase_ns += duration_cast<nanoseconds>(chase_end - chase_begin).count();
+    });
+    if (fut.second)
+        for (auto& f : fut.first)
+            f.get();
+    auto total_ms = duration_cast<milliseconds>(steady_clock::now() - begin).count();
+    auto bytes = (unsigned long long)task_number * length * sizeof(size_t) * (4 * 2 + 1);
+    debug_output<true>(_T("affinity "), name, _T(": stream "), bytes * 1000 / (stream_ns ? stream_ns.load() : 1), _T("MB/s per thread, random read "),
+        chase_ns.load() / ((long long)task_number * length), _T("ns, total "), total_ms, _T("ms, checksum "), checksum.load());
+}
+
+// 自动调整线程数：突发任务时增加线程，空闲后逐步减少到最小值
+void test_autoscale(int max_threads, int count)
+{
+    threadpool<false> thpool(1);
+    autoscale_config config;
+    config.min_threads = 1;
+    config.max_threads = max_threads;
+    config.interval = milliseconds(20);
+    config.shrink_hold = 3;
+    thpool.start_autoscale(config);
+    auto begin = steady_clock::now();
+    for (int i = 0; i < count; i++)
+        thpool.push([]{ this_thread::sleep_for(microseconds(500)); });
+    int peak_thread_number = 0;
+    while (thpool.get_tasks_number())
+    {
+        peak_thread_number = auto_max(peak_thread_number, thpool.get_thread_number());
+        this_thread::sleep_for(milliseconds(5));
+    }
+    auto drain_ms = duration_cast<milliseconds>(steady_clock::now() - begin).count();
+    while (thpool.get_thread_number() > config.min_threads && steady_clock::now() - begin < seconds(10))
+        this_thread::sleep_for(milliseconds(10));
+    debug_output<true>(_T("autoscale "), count, _T(" tasks: drain "), drain_ms, _T("ms, peak threads "), peak_thread_number,
+        _T(", final threads "), thpool.get_thread_number(), _T(", decisions "), thpool.get_autoscale_decisions().size());
+    for (auto& decision : thpool.get_autoscale_decisions())
+        debug_output<true>(_T("  "), decision.old_thread_number, _T(" -> "), decision.new_thread_number, _T(" reason "), (int)decision.reason,
+            _T(" queue "), decision.queue_depth, _T(" delay "), decision.queue_delay.count(), _T("us utilization "), decision.utilization);
+}
+
+
+// 锁竞争：thread_number个线程反复加锁、递增计数、解锁，检查互斥并统计每次加锁解锁的平均时间
+template<class lock_type> void test_lock_contention(const tstring& name, int thread_number, int count)
+{
+    lock_type lock;
+    long long counter = 0;
+    vector<thread> threads;
+    auto begin = steady_clock::now();
+    for (int i = 0; i < thread_number; i++)
+        threads.emplace_back([&]
+        {
+            for (int j = 0; j < count; j++)
+            {
+                lock_guard<lock_type> lck(lock);
+                counter++;
+            }
+        });
+    for (auto& val : threads)
+        val.join();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(_T("lock "), name, _T(" threads "), thread_number, _T(": "), ns / ((long long)thread_number * count), _T("ns/op, counter "),
+        counter == (long long)thread_number * count ? _T("ok") : _T("mismatch"));
+}
+
+// 计数器扩展性：多个线程同时递增一个计数器，共享的原子变量在线程间反复传递缓存行，分片计数器每个线程修改自己的缓存行
+template<class counter_type> void test_counter_scaling(const tstring& name, int thread_number, size_t count)
+{
+    counter_type counter{};
+    vector<thread> threads;
+    auto begin = steady_clock::now();
+    for (int i = 0; i < thread_number; i++)
+        threads.emplace_back([&]
+        {
+            for (size_t j = 0; j < count; j++)
+                counter++;
+        });
+    for (auto& val : threads)
+        val.join();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(_T("counter "), name, _T(" threads "), thread_number, _T(": "), ns * 1000 / ((long long)thread_number * count), _T("ps/op, counter "),
+        counter.load() == (size_t)thread_number * count ? _T("ok") : _T("mismatch"));
+}
+
+// 任务队列锁：多个线程同时向共享队列添加空任务，直到任务全部执行完毕
+template<class lock_type> void test_task_lock(const tstring& name, int producer_number, size_t count)
+{
+    threadpool<false, lock_type> thpool(4);
+    thpool.set_schedule_mode(schedule_mode::shared_queue);
+    vector<thread> producers;
+    auto begin = steady_clock::now();
+    for (int i = 0; i < producer_number; i++)
+        producers.emplace_back([&]
+        {
+            for (size_t j = 0; j < count; j++)
+                thpool.push([]{});
+        });
+    for (auto& val : producers)
+        val.join();
+    while (thpool.get_tasks_completed_number() < count * producer_number)
+        this_thread::yield();
+    auto ns = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    debug_output<true>(_T("task lock "), name, _T(" producers "), producer_number, _T(": "), count * producer_number * 1000000000ull / (ns ? ns : 1), _T(" tasks/s"));
+}
+
 
 int main()
 {
@@ -56,6 +912,54 @@ int main()
     thpool2.push(bind(foo, _1, _2, 300), 1, '7'); // 测试bind+placeholders
     auto&& bind_obj = bind(foo, 1, _1, 300);
     thpool2.push(ref(bind_obj), '8'); // 测试function_wrapper
+    thpool2.push(move_only_task{ unique_ptr<int>(new int(9)) }); // 测试只能移动的函数对象
+
+    auto pool_fut1 = thpool2.push_pool_future([]{ return 10; }); // push_pool_future
+    auto pool_fut2 = pool_fut1.first.then([](const pool_future<int>& f){ return f.get() * 2; }); // then
+    auto pool_fut3 = thpool2.push_pool_future([]{ throw runtime_error("pool_future exception"); });
+    auto all_fut = when_all(pool_fut1.first, pool_fut2, pool_fut3.first); // when_all
+    auto any_fut = when_any(vector<pool_future<int>>{ pool_fut1.first, pool_fut2 }); // when_any
+    auto_wait_future<void> auto_wait_pool(all_fut); // auto_wait_future
+    all_fut.then([&](const pool_future<void>&)
+    {
+        try
+        {
+            pool_fut3.first.get();
+        }
+        catch (exception& e)
+        {
+            debug_output<true>(_T("when_all: "), pool_fut1.first.get(), _T(' '), pool_fut2.get(), _T(' '), e.what());
+        }
+    }).wait();
+    debug_output<true>(_T("when_any: "), any_fut.get());
+#ifdef THREADPOOL_COROUTINE
+    auto coroutine_fut = thpool2.push_coroutine(coroutine_sum(thpool2, 100)); // push_coroutine
+    if (coroutine_fut.second)
+        debug_output<true>(_T("coroutine sum: "), coroutine_fut.first.get());
+    threadpool<false> full_pool(1);
+    full_pool.pause();
+    full_pool.set_capacity(1, overflow_policy::fail);
+    full_pool.push([]{});
+    auto rejected_fut = thpool2.push_coroutine(coroutine_rejected(full_pool));
+    if (rejected_fut.second)
+        debug_output<true>(_T("coroutine rejected: "), rejected_fut.first.get());
+    full_pool.clear();
+#endif // #ifdef THREADPOOL_COROUTINE
+
+    vector<int> squares(100);
+    thpool2.parallel_for(0, (int)squares.size(), [&](int i){ squares[i] = i * i; }); // parallel_for
+    auto&& square_sum = thpool2.parallel_reduce(0, (int)squares.size(), 0, [&](int i){ return squares[i]; }, plus<int>()); // parallel_reduce
+    int left = 0, right = 0;
+    thpool2.parallel_invoke([&]{ left = square_sum; }, [&]{ right = square_sum * 2; }); // parallel_invoke
+    debug_output<true>(_T("parallel square sum: "), square_sum, _T(", invoke: "), left, _T(' '), right);
+    try
+    {
+        thpool2.parallel_for(0, 100, 1, [](int i){ if (i == 50) throw i; }); // 异常在调用线程重新抛出
+    }
+    catch (int i)
+    {
+        debug_output<true>(_T("parallel_for exception: "), i);
+    }
 
     c = 'A';
     for (int i = 0; i < 32; i++)
@@ -87,6 +991,68 @@ int main()
     // 同步线程池分离的任务
     debug_output<true>(_T("detach thread result: "), fut_res.get());
 
+    test_task_priority(32);
+    test_task_priority(0);
+
+    // 性能测试
+    threadpool<false> thpool_bench(4);
+    test_wakeup_latency(thpool_bench, 200);
+    test_throughput(thpool_bench, 100000);
+    test_batch_dequeue(1, 100000);
+    test_batch_dequeue(16, 100000);
+    test_bulk_submit(thpool_bench, 1000);
+    test_bulk_submit(thpool_bench, 10000);
+    test_bulk_submit(thpool_bench, 100000);
+    test_bulk_submit(thpool_bench, 1000000);
+    test_detach(1000, 20);
+    test_worker_budget();
+    test_dispatcher(10000);
+    test_task_failures(100000, 0, 0);
+    test_task_failures(100000, 100, 0);
+    test_task_failures(100000, 100, 2);
+    test_task_arena(thpool_bench, 10000);
+    test_task_arena(thpool_bench, 100000);
+    test_help_wait(1, 1000, 16);
+    test_help_wait(4, 10000, 16);
+#ifdef THREADPOOL_HISTOGRAM
+    test_task_histogram(100000);
+#endif
+    test_idle_policy(thpool_bench, idle_policy::park, _T("park"), 2000, 20);
+    test_idle_policy(thpool_bench, idle_policy::yield, _T("yield"), 2000, 20);
+    test_idle_policy(thpool_bench, idle_policy::spin, _T("spin"), 2000, 20);
+    test_schedule_scaling(schedule_mode::shared_queue, 16);
+    test_schedule_scaling(schedule_mode::work_stealing, 16);
+    test_timer(thpool_bench, 10000);
+    test_cancellation(100000);
+    test_bounded_queue(overflow_policy::block, _T("block"), 256, 100000);
+    test_bounded_queue(overflow_policy::fail, _T("fail"), 256, 100000);
+    test_bounded_queue(overflow_policy::caller_runs, _T("caller_runs"), 256, 100000);
+    test_bounded_queue(overflow_policy::drop_oldest, _T("drop_oldest"), 256, 100000);
+    test_future_then(thpool_bench, 10000);
+    test_task_graph(thpool_bench, 10, 20, 100);
+    test_parallel_reduce(thpool_bench, 10000000, 1000);
+    test_parallel_reduce(thpool_bench, 10000000, 100000);
+    test_thread_affinity(thread_affinity::none, _T("none"));
+    test_thread_affinity(thread_affinity::per_cpu, _T("per_cpu"));
+    test_thread_affinity(thread_affinity::spread_cores, _T("spread_cores"));
+    test_thread_affinity(thread_affinity::spread_numa, _T("spread_numa"));
+    test_autoscale(8, 2000);
+    test_lock_contention<spin_mutex>(_T("spin_mutex"), 4, 200000);
+    test_lock_contention<ttas_mutex>(_T("ttas_mutex"), 4, 200000);
+    test_lock_contention<ticket_mutex>(_T("ticket_mutex"), 4, 200000);
+    test_lock_contention<mcs_mutex>(_T("mcs_mutex"), 4, 200000);
+    test_lock_contention<adaptive_mutex>(_T("adaptive_mutex"), 4, 200000);
+    test_lock_contention<mutex>(_T("std::mutex"), 4, 200000);
+    test_task_lock<spin_mutex>(_T("spin_mutex"), 4, 50000);
+    test_task_lock<ttas_mutex>(_T("ttas_mutex"), 4, 50000);
+    test_task_lock<ticket_mutex>(_T("ticket_mutex"), 4, 50000);
+    test_task_lock<mcs_mutex>(_T("mcs_mutex"), 4, 50000);
+    test_task_lock<adaptive_mutex>(_T("adaptive_mutex"), 4, 50000);
+    test_counter_scaling<atomic<size_t>>(_T("atomic"), 16, 1000000);
+    test_counter_scaling<sharded_counter>(_T("sharded"), 16, 1000000);
+    test_counter_scaling<atomic<size_t>>(_T("atomic"), 32, 1000000);
+    test_counter_scaling<sharded_counter>(_T("sharded"), 32, 1000000);
+
     // 关闭日志流
     close_log_location();
 